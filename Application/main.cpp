@@ -3,11 +3,81 @@
 #include <Server/Server.h>
 
 int main() {
-    std::cout << "Hello, It's Server!\n";
     try {
-        Server server(net::ip::make_address("127.0.0.1"), 8080);
+        LogLevel logLevel = LogLevel::Info;
+        if (const char *env = std::getenv("FINANCE_LOG_LEVEL")) {
+            logLevel = Logger::parseLevel(env);
+        }
+        unsigned accessSample = 1;
+        if (const char *env = std::getenv("FINANCE_ACCESS_LOG_SAMPLE")) {
+            accessSample = std::stoul(env);
+        }
+        Logger::get().configure(logLevel, accessSample);
+        Logger::info("Hello, It's Server!");
+
+        std::size_t dbPoolSize = 8;
+        if (const char *env = std::getenv("FINANCE_DB_POOL_SIZE")) {
+            dbPoolSize = std::stoul(env);
+        }
+        std::size_t threads = 1;
+        if (const char *env = std::getenv("FINANCE_THREADS")) {
+            threads = std::stoul(env);
+        }
+        std::string storage = "postgres";
+        if (const char *env = std::getenv("FINANCE_STORAGE")) {
+            storage = env;
+        }
+        bool analytics = false;
+        if (const char *env = std::getenv("FINANCE_ANALYTICS")) {
+            analytics = std::string_view(env) == "1";
+        }
+        bool dbPipeline = false;
+        if (const char *env = std::getenv("FINANCE_DB_PIPELINE")) {
+            dbPipeline = std::string_view(env) == "1";
+        }
+        std::size_t responseCacheMb = 0;
+        if (const char *env = std::getenv("FINANCE_RESPONSE_CACHE_MB")) {
+            responseCacheMb = std::stoul(env);
+        }
+        CompressionSettings compression;
+        if (const char *env = std::getenv("FINANCE_COMPRESSION")) {
+            compression.enabled = std::string_view(env) != "0";
+        }
+        if (const char *env = std::getenv("FINANCE_COMPRESSION_MIN_BYTES")) {
+            compression.minBytes = std::stoul(env);
+        }
+        if (const char *env = std::getenv("FINANCE_GZIP_LEVEL")) {
+            compression.gzipLevel = std::stoi(env);
+        }
+        if (const char *env = std::getenv("FINANCE_ZSTD_LEVEL")) {
+            compression.zstdLevel = std::stoi(env);
+        }
+        Compressor::configure(compression);
+        Limits limits;
+        if (const char *env = std::getenv("FINANCE_IDLE_TIMEOUT")) {
+            limits.idleTimeout = std::chrono::seconds(std::stoul(env));
+        }
+        if (const char *env = std::getenv("FINANCE_WRITE_TIMEOUT")) {
+            limits.writeTimeout = std::chrono::seconds(std::stoul(env));
+        }
+        if (const char *env = std::getenv("FINANCE_BODY_LIMIT")) {
+            limits.bodyLimit = std::stoul(env);
+        }
+        if (const char *env = std::getenv("FINANCE_MAX_CONNECTIONS")) {
+            limits.maxConnections = std::stoul(env);
+        }
+        if (const char *env = std::getenv("FINANCE_DB_QUEUE_TARGET_MS")) {
+            limits.queueTarget = std::chrono::milliseconds(std::stoul(env));
+        }
+        if (const char *env = std::getenv("FINANCE_RETRY_AFTER")) {
+            limits.retryAfter = std::chrono::seconds(std::stoul(env));
+        }
+        Server server(net::ip::make_address("127.0.0.1"), 8080, dbPoolSize, threads, storage, analytics, dbPipeline,
+                      responseCacheMb << 20, limits);
         server.run();
+        Logger::get().stop();
     } catch (std::exception &e) {
+        Logger::get().stop(); // Queued records go out before the error
         std::cerr << "Error: " << e.what() << std::endl;
         return EXIT_FAILURE;
     }
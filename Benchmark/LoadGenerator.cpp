@@ -0,0 +1,236 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+#define CONNECTION_FAILED UINT32_MAX // Sample of a connection that failed outside any one request
+
+// Drives the server over many connections for a fixed time and prints throughput and latency percentiles as JSON.
+// Usage: LoadGenerator [host] [port] [connections] [seconds] [target] [keep-alive]
+//   target      a single GET target, or "all" for a weighted mix of every endpoint in the README (default)
+//   keep-alive  share of requests sent with keep-alive, the rest close their connection (default 1)
+// The mix expects a database freshly seeded from MEGAADDER.sql. Writes add matching expenses and income to the
+// same account, modifications write back the seeded values and deletions target ids that don't exist, so the
+// balances and the seeded rows stay as they were.
+
+struct Options {
+    std::string host = "127.0.0.1";
+    std::string port = "8080";
+    std::size_t connections = 64;
+    int seconds = 10;
+    std::string target = "all";
+    double keepAlive = 1.0;
+};
+
+struct Scenario {
+    http::verb verb;
+    std::string target;
+    std::string body;
+    http::status expected;
+    unsigned weight;
+};
+
+struct Sample {
+    std::uint32_t scenario;
+    std::uint32_t microseconds;
+    bool failed;
+};
+
+static std::vector<Scenario> makeScenarios(const Options &options) {
+    if (options.target != "all") {
+        return {{http::verb::get, options.target, "", http::status::ok, 1}};
+    }
+
+    const std::string range = "begin=2022-12-01&end=2023-12-31";
+    const std::string operation = R"({"id_cat": 3, "id_account": 1, "amount": 100, "date": "2023-03-01", "time": "12:00"})";
+    std::string batch;
+    for (int i = 0; i < 10; ++i) {
+        batch += operation + "\n";
+    }
+
+    return {
+        {http::verb::get, "/accounts?id=1", "", http::status::ok, 10},
+        {http::verb::get, "/expenses?id=2", "", http::status::ok, 10},
+        {http::verb::get, "/income?id=2", "", http::status::ok, 10},
+        {http::verb::get, "/expenses?" + range, "", http::status::ok, 5},
+        {http::verb::get, "/income?" + range, "", http::status::ok, 5},
+        {http::verb::get, "/expenses?" + range + "&limit=2", "", http::status::ok, 3},
+        {http::verb::get, "/categories/expenses?id=2&" + range, "", http::status::ok, 3},
+        {http::verb::get, "/categories/income?id=2&" + range, "", http::status::ok, 3},
+        {http::verb::get, "/categories/expenses", "", http::status::ok, 3},
+        {http::verb::get, "/categories/income", "", http::status::ok, 3},
+        {http::verb::get, "/summary/expenses?" + range + "&by=category&period=month", "", http::status::ok, 3},
+        {http::verb::get, "/summary/income?" + range + "&by=account&period=day", "", http::status::ok, 3},
+
+        {http::verb::post, "/expenses", operation, http::status::created, 2},
+        {http::verb::post, "/income", operation, http::status::created, 2},
+        {http::verb::post, "/expenses/batch", batch, http::status::created, 1},
+        {http::verb::post, "/income/batch", batch, http::status::created, 1},
+
+        {http::verb::put, "/accounts", R"({"id_account": 3, "name": "VTB"})", http::status::ok, 1},
+        {http::verb::put, "/expenses",
+         R"({"id_expense": 2, "id_cat": 2, "id_account": 2, "amount": 98, "date": "2023-01-29", "time": "13:31"})",
+         http::status::ok, 1},
+        {http::verb::put, "/income",
+         R"({"id_income": 2, "id_cat": 2, "id_account": 2, "amount": 20000, "date": "2023-01-15", "time": "16:31"})",
+         http::status::ok, 1},
+        {http::verb::put, "/categories/expenses", R"({"id_cat": 2, "name": "Products"})", http::status::ok, 1},
+        {http::verb::put, "/categories/income", R"({"id_cat": 2, "name": "Salary"})", http::status::ok, 1},
+
+        {http::verb::delete_, "/expenses?id=2147483647", "", http::status::bad_request, 1},
+        {http::verb::delete_, "/income?id=2147483647", "", http::status::bad_request, 1},
+        {http::verb::delete_, "/accounts?id=2147483647", "", http::status::bad_request, 1},
+        {http::verb::delete_, "/categories/expenses?id=2147483647", "", http::status::bad_request, 1},
+        {http::verb::delete_, "/categories/income?id=2147483647", "", http::status::bad_request, 1},
+    };
+}
+
+static void runClient(const Options &options, const std::vector<Scenario> &scenarios, unsigned seed,
+                      const std::atomic<bool> &stop, std::vector<Sample> &samples) {
+    net::io_context ioc;
+    tcp::resolver resolver(ioc);
+    auto endpoints = resolver.resolve(options.host, options.port);
+
+    // Every client draws the same sequence for a given seed, so runs are comparable
+    std::mt19937 random(seed);
+    std::vector<unsigned> weights;
+    for (const auto &scenario : scenarios) {
+        weights.push_back(scenario.weight);
+    }
+    std::discrete_distribution<std::uint32_t> pick(weights.begin(), weights.end());
+    std::bernoulli_distribution keepAlive(options.keepAlive);
+
+    while (!stop) {
+        try {
+            beast::tcp_stream stream(ioc);
+            stream.connect(endpoints);
+
+            beast::flat_buffer buffer;
+            bool open = true;
+            while (!stop && open) {
+                std::uint32_t index = pick(random);
+                const Scenario &scenario = scenarios[index];
+                http::request<http::string_body> req{scenario.verb, scenario.target, 11};
+                req.set(http::field::host, options.host);
+                if (!scenario.body.empty()) {
+                    req.set(http::field::content_type, "application/json");
+                    req.body() = scenario.body;
+                }
+                req.keep_alive(keepAlive(random));
+                req.prepare_payload();
+
+                auto started = std::chrono::steady_clock::now();
+                http::write(stream, req);
+                http::response<http::string_body> res;
+                http::read(stream, buffer, res);
+                auto latency = std::chrono::steady_clock::now() - started;
+
+                samples.push_back({index,
+                                   static_cast<std::uint32_t>(
+                                       std::chrono::duration_cast<std::chrono::microseconds>(latency).count()),
+                                   res.result() != scenario.expected});
+                open = req.keep_alive() && res.keep_alive();
+            }
+        } catch (const std::exception &) {
+            samples.push_back({CONNECTION_FAILED, 0, true});
+        }
+    }
+}
+
+// Percentile of sorted latencies, nearest rank
+static std::uint32_t percentile(const std::vector<std::uint32_t> &sorted, double p) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    auto rank = static_cast<std::size_t>(p * static_cast<double>(sorted.size()) + 0.999999);
+    return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static void printLatencies(std::vector<std::uint32_t> &latencies) {
+    std::sort(latencies.begin(), latencies.end());
+    std::cout << "\"p50_us\": " << percentile(latencies, 0.5) << ", \"p99_us\": " << percentile(latencies, 0.99)
+              << ", \"p999_us\": " << percentile(latencies, 0.999)
+              << ", \"max_us\": " << (latencies.empty() ? 0 : latencies.back());
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (argc > 1) options.host = argv[1];
+    if (argc > 2) options.port = argv[2];
+    if (argc > 3) options.connections = std::stoul(argv[3]);
+    if (argc > 4) options.seconds = std::stoi(argv[4]);
+    if (argc > 5) options.target = argv[5];
+    if (argc > 6) options.keepAlive = std::clamp(std::stod(argv[6]), 0.0, 1.0);
+
+    const std::vector<Scenario> scenarios = makeScenarios(options);
+    std::atomic<bool> stop{false};
+
+    // Each client keeps its own samples, they are merged once the run is over
+    std::vector<std::vector<Sample>> samples(options.connections);
+    std::vector<std::thread> clients;
+    clients.reserve(options.connections);
+    auto started = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < options.connections; ++i) {
+        samples[i].reserve(1 << 14);
+        clients.emplace_back(runClient, std::cref(options), std::cref(scenarios), static_cast<unsigned>(i + 1),
+                             std::cref(stop), std::ref(samples[i]));
+    }
+
+    std::this_thread::sleep_for(std::chrono::seconds(options.seconds));
+    stop = true;
+    for (auto &client : clients) {
+        client.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+
+    std::vector<std::uint32_t> all;
+    std::vector<std::vector<std::uint32_t>> byScenario(scenarios.size());
+    std::vector<std::uint64_t> errors(scenarios.size());
+    std::uint64_t completed = 0;
+    std::uint64_t failed = 0;
+    for (const auto &client : samples) {
+        for (const auto &sample : client) {
+            if (sample.failed) {
+                failed++;
+                if (sample.scenario != CONNECTION_FAILED) {
+                    errors[sample.scenario]++;
+                }
+                continue;
+            }
+            completed++;
+            all.push_back(sample.microseconds);
+            byScenario[sample.scenario].push_back(sample.microseconds);
+        }
+    }
+
+    std::cout << "{\"target\": \"" << options.target << "\", \"connections\": " << options.connections
+              << ", \"keep_alive\": " << options.keepAlive << ", \"seconds\": " << elapsed.count()
+              << ", \"requests\": " << completed << ", \"errors\": " << failed
+              << ", \"rps\": " << completed / elapsed.count() << ", ";
+    printLatencies(all);
+    std::cout << ", \"endpoints\": [";
+    for (std::size_t i = 0; i < scenarios.size(); ++i) {
+        std::cout << (i == 0 ? "" : ", ") << "{\"request\": \"" << http::to_string(scenarios[i].verb) << " "
+                  << scenarios[i].target << "\", \"requests\": " << byScenario[i].size()
+                  << ", \"errors\": " << errors[i] << ", ";
+        printLatencies(byScenario[i]);
+        std::cout << "}";
+    }
+    std::cout << "]}\n";
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,315 @@
+#include <Server/Cbor.h>
+#include <Server/ColumnStore.h>
+#include <Server/Compression.h>
+#include <Server/Json.h>
+#include <Server/MemoryStorage.h>
+#include <Server/Metrics.h>
+#include <Server/MsgPack.h>
+#include <Server/Query.h>
+#include <Server/Router.h>
+
+#include <array>
+#include <cstdio>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <benchmark/benchmark.h>
+
+// Micro-benchmarks of the request path pieces that don't need a database: JSON, CBOR and MessagePack, the query string,
+// routing, metrics, response compression and the in-memory storage. Run with --benchmark_format=json to compare
+// results between commits.
+
+#define ROWS_PER_RESPONSE 100
+
+namespace {
+    const std::string_view expenseBody = R"({
+  "id_cat": "3",
+  "id_account": "1",
+  "amount": "1000",
+  "date": "2022-12-12",
+  "time": "12:12",
+  "comment": "Pyaterochka"
+})";
+
+    std::string batchBody(std::size_t operations) {
+        std::string body = "[";
+        for (std::size_t i = 0; i < operations; ++i) {
+            body += i == 0 ? "" : ",";
+            body += R"({"id_cat": 3, "id_account": 1, "amount": 1000, "date": "2022-12-12", "time": "12:12"})";
+        }
+        return body + "]";
+    }
+
+    const Operation expense{12345, 3, 1, Money::fromMinor(100050), "2022-12-12", "12:12:00", "Pyaterochka \"5\""};
+
+    // Same shape as the server's route table, with the handler replaced by its position
+    constexpr auto router = makeRouter<int>({
+        {boost::beast::http::verb::post, "/accounts", 0},
+        {boost::beast::http::verb::post, "/expenses", 1},
+        {boost::beast::http::verb::post, "/income", 2},
+        {boost::beast::http::verb::post, "/expenses/batch", 3},
+        {boost::beast::http::verb::post, "/income/batch", 4},
+        {boost::beast::http::verb::post, "/categories/expenses", 5},
+        {boost::beast::http::verb::post, "/categories/income", 6},
+        {boost::beast::http::verb::put, "/accounts", 7},
+        {boost::beast::http::verb::put, "/expenses", 8},
+        {boost::beast::http::verb::put, "/income", 9},
+        {boost::beast::http::verb::put, "/categories/expenses", 10},
+        {boost::beast::http::verb::put, "/categories/income", 11},
+        {boost::beast::http::verb::get, "/accounts", 12},
+        {boost::beast::http::verb::get, "/expenses", 13},
+        {boost::beast::http::verb::get, "/income", 14},
+        {boost::beast::http::verb::get, "/categories/expenses", 15},
+        {boost::beast::http::verb::get, "/categories/income", 16},
+        {boost::beast::http::verb::get, "/summary/expenses", 17},
+        {boost::beast::http::verb::get, "/summary/income", 18},
+        {boost::beast::http::verb::delete_, "/accounts", 19},
+        {boost::beast::http::verb::delete_, "/expenses", 20},
+        {boost::beast::http::verb::delete_, "/income", 21},
+        {boost::beast::http::verb::delete_, "/categories/expenses", 22},
+        {boost::beast::http::verb::delete_, "/categories/income", 23},
+        {boost::beast::http::verb::get, "/metrics", 24, false},
+    });
+}
+
+static void BM_JsonParse(benchmark::State &state) {
+    for (auto _ : state) {
+        JsonObject root = JsonObject::parse(expenseBody);
+        benchmark::DoNotOptimize(root.get<Money>("amount"));
+    }
+    state.SetBytesProcessed(state.iterations() * expenseBody.size());
+}
+BENCHMARK(BM_JsonParse);
+
+static void BM_JsonParseBatch(benchmark::State &state) {
+    const std::string body = batchBody(state.range(0));
+    for (auto _ : state) {
+        Money total;
+        forEachJsonObject(body, [&](const JsonObject &root) { total += root.get<Money>("amount"); });
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JsonParseBatch)->Arg(10)->Arg(1000);
+
+// Writes rows the way Exchange::toJsonRows does
+static void BM_ToJson(benchmark::State &state) {
+    std::array<std::byte, 64 * 1024> buffer;
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        JsonWriter writer(&arena);
+        writer.beginArray();
+        for (int i = 0; i < ROWS_PER_RESPONSE; ++i) {
+            writer.beginObject();
+            writer.key("id_expense").value(expense.id);
+            writer.key("id_cat").value(expense.id_cat);
+            writer.key("id_account").value(expense.id_account);
+            writer.key("amount").value(expense.amount);
+            writer.key("date").value(expense.date);
+            writer.key("time").value(expense.time);
+            writer.key("comment").value(*expense.comment);
+            writer.endObject();
+        }
+        writer.endArray();
+        benchmark::DoNotOptimize(writer.str().data());
+    }
+    state.SetItemsProcessed(state.iterations() * ROWS_PER_RESPONSE);
+}
+BENCHMARK(BM_ToJson);
+
+// The rows of BM_ToJson through the Encoder interface the handlers use; the argument is 0 for JSON, 1 for CBOR and
+// 2 for MessagePack
+static void BM_EncodeRows(benchmark::State &state) {
+    std::array<std::byte, 64 * 1024> buffer;
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        JsonWriter json(&arena);
+        CborWriter cbor(&arena);
+        MsgPackWriter msgPack(&arena);
+        Encoder &writer = state.range(0) == 0 ? static_cast<Encoder &>(json)
+                          : state.range(0) == 1 ? static_cast<Encoder &>(cbor) : msgPack;
+        writer.beginArray();
+        for (int i = 0; i < ROWS_PER_RESPONSE; ++i) {
+            writer.beginObject();
+            writer.key("id_expense").value(expense.id);
+            writer.key("id_cat").value(expense.id_cat);
+            writer.key("id_account").value(expense.id_account);
+            writer.key("amount").value(expense.amount);
+            writer.key("date").date(expense.date);
+            writer.key("time").value(expense.time);
+            writer.key("comment").value(*expense.comment);
+            writer.endObject();
+        }
+        writer.endArray();
+        bytes = writer.str().size();
+        benchmark::DoNotOptimize(writer.str().data());
+    }
+    state.SetItemsProcessed(state.iterations() * ROWS_PER_RESPONSE);
+    state.counters["bytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_EncodeRows)->Arg(0)->Arg(1)->Arg(2);
+
+// Rows the way Exchange::toJsonRows writes them for ?shape=columns
+static void writeColumns(JsonWriter &writer) {
+    writer.beginObject().key("columns").beginArray();
+    for (const char *column : {"id_expense", "id_cat", "id_account", "amount", "date", "time", "comment"}) {
+        writer.value(column);
+    }
+    writer.endArray().key("rows").beginArray();
+    for (int i = 0; i < ROWS_PER_RESPONSE; ++i) {
+        writer.beginArray();
+        writer.value(expense.id).value(expense.id_cat).value(expense.id_account).value(expense.amount);
+        writer.value(expense.date).value(expense.time).value(*expense.comment);
+        writer.endArray();
+    }
+    writer.endArray().endObject();
+}
+
+static void BM_ToJsonColumns(benchmark::State &state) {
+    std::array<std::byte, 64 * 1024> buffer;
+    std::size_t bytes = 0;
+    for (auto _ : state) {
+        std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+        JsonWriter writer(&arena);
+        writeColumns(writer);
+        bytes = writer.str().size();
+        benchmark::DoNotOptimize(writer.str().data());
+    }
+    state.SetItemsProcessed(state.iterations() * ROWS_PER_RESPONSE);
+    state.counters["bytes"] = static_cast<double>(bytes);
+}
+BENCHMARK(BM_ToJsonColumns);
+
+// gzip of a range response at the default level; the argument picks the shape, 1 for columns
+static void BM_GzipResponse(benchmark::State &state) {
+    JsonWriter writer;
+    if (state.range(0) == 1) {
+        writeColumns(writer);
+    } else {
+        writer.beginArray();
+        for (int i = 0; i < ROWS_PER_RESPONSE; ++i) {
+            writer.beginObject().key("id_expense").value(expense.id).key("id_cat").value(expense.id_cat);
+            writer.key("id_account").value(expense.id_account).key("amount").value(expense.amount);
+            writer.key("date").value(expense.date).key("time").value(expense.time);
+            writer.key("comment").value(*expense.comment).endObject();
+        }
+        writer.endArray();
+    }
+    std::string_view body = writer.str();
+
+    std::size_t compressed = 0;
+    for (auto _ : state) {
+        ArenaString out;
+        Compressor(ContentEncoding::Gzip).compress(body, out, true);
+        compressed = out.size();
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * body.size());
+    state.counters["bytes"] = static_cast<double>(body.size());
+    state.counters["compressed"] = static_cast<double>(compressed);
+}
+BENCHMARK(BM_GzipResponse)->Arg(0)->Arg(1);
+
+static void BM_JsonWriteNumbers(benchmark::State &state) {
+    for (auto _ : state) {
+        JsonWriter writer(4096);
+        writer.beginArray();
+        for (int i = 0; i < ROWS_PER_RESPONSE; ++i) {
+            writer.value(static_cast<std::int64_t>(i) * 1000003).value(i * 0.25);
+        }
+        writer.endArray();
+        benchmark::DoNotOptimize(writer.str().data());
+    }
+}
+BENCHMARK(BM_JsonWriteNumbers);
+
+static void BM_QueryParse(benchmark::State &state) {
+    const std::string_view target =
+        "/categories/expenses?id=2&begin=2022-12-01&end=2023-12-31&limit=100&cursor=2023-01-29_13%3A31%3A00_2";
+    Target parsed;
+    for (auto _ : state) {
+        parsed.parse(target);
+        benchmark::DoNotOptimize(parsed.query.get<int>("id"));
+        benchmark::DoNotOptimize(parsed.query["cursor"].data());
+    }
+}
+BENCHMARK(BM_QueryParse);
+
+static void BM_Route(benchmark::State &state) {
+    const std::array<std::pair<boost::beast::http::verb, std::string_view>, 4> requests = {{
+        {boost::beast::http::verb::get, "/expenses"},
+        {boost::beast::http::verb::post, "/categories/income"},
+        {boost::beast::http::verb::delete_, "/accounts"},
+        {boost::beast::http::verb::get, "/unknown"},
+    }};
+    std::size_t i = 0;
+    for (auto _ : state) {
+        const auto &[verb, path] = requests[i++ % requests.size()];
+        benchmark::DoNotOptimize(router.find(verb, path));
+    }
+}
+BENCHMARK(BM_Route);
+
+static void BM_MetricsRecord(benchmark::State &state) {
+    PhaseTimer timer;
+    for (auto _ : state) {
+        timer.start();
+        timer.enter(Phase::Db);
+        timer.enter(Phase::Write);
+        timer.stop();
+        Metrics::get().record(1, 200, timer);
+    }
+}
+BENCHMARK(BM_MetricsRecord)->ThreadRange(1, 8);
+
+// A year of operations, a month of them is read per iteration
+static void BM_MemoryStorageRange(benchmark::State &state) {
+    MemoryStorage storage(false);
+    storage.addAccount("Account", Money());
+    std::vector<Operation> operations;
+    for (int day = 1; day <= 28; ++day) {
+        for (int month = 1; month <= 12; ++month) {
+            for (int i = 0; i < state.range(0); ++i) {
+                char date[16];
+                std::snprintf(date, sizeof(date), "2023-%02d-%02d", month, day);
+                operations.push_back({0, OTHER_CATEGORY_ID, 1, Money::fromUnits(100), date, "12:00:00", ""});
+            }
+        }
+    }
+    storage.addOperations(Ledger::Expenses, operations);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(storage.listOperations(Ledger::Expenses, {"2023-06-01", "2023-06-30"}).size());
+    }
+    state.SetItemsProcessed(state.iterations() * 28 * state.range(0));
+}
+BENCHMARK(BM_MemoryStorageRange)->Arg(1)->Arg(100);
+
+static void BM_MemoryStorageSummary(benchmark::State &state) {
+    MemoryStorage storage;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(
+            storage.summary(Ledger::Expenses, "2022-12-01", "2023-12-31", SummaryBy::Category, "month").size());
+    }
+}
+BENCHMARK(BM_MemoryStorageSummary);
+
+// Summary over a year of operations in the analytics read model: 7 categories, state.range(0) operations a day
+static void BM_ColumnStoreSummary(benchmark::State &state) {
+    ColumnStore store;
+    std::int32_t id = 1;
+    for (std::int32_t day = 19358; day < 19358 + 365; ++day) { // 2023
+        for (int i = 0; i < state.range(0); ++i, ++id) {
+            store.insert({id, day, i, Money::fromMinor(id % 100000), id % 7 + 1, id % 3 + 1});
+        }
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(store.summary(19358, 19358 + 364, SummaryBy::Category, "month").size());
+    }
+    state.SetItemsProcessed(state.iterations() * 365 * state.range(0));
+}
+BENCHMARK(BM_ColumnStoreSummary)->Arg(100)->Arg(3000);
+
+BENCHMARK_MAIN();
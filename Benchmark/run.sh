@@ -0,0 +1,29 @@
+#!/usr/bin/env bash
+# Seeds a local Postgres from MEGAADDER.sql, runs the micro-benchmarks and the load generator with the full endpoint
+# mix and writes both results to Benchmark/results/<commit>.json, so runs can be compared between commits.
+# Usage: Benchmark/run.sh <build directory> [connections] [seconds] [keep-alive]
+set -euo pipefail
+
+BUILD=${1:?build directory}
+CONNECTIONS=${2:-64}
+SECONDS_PER_RUN=${3:-10}
+KEEP_ALIVE=${4:-1}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+RESULTS="$ROOT/Benchmark/results"
+COMMIT=$(git -C "$ROOT" rev-parse --short HEAD)
+
+export PGHOST=${PGHOST:-localhost} PGUSER=${PGUSER:-postgres}
+createdb finance 2> /dev/null || true
+psql --quiet --dbname finance --file "$ROOT/MEGAADDER.sql" > /dev/null
+
+mkdir -p "$RESULTS"
+MICRO=$("$BUILD/Benchmark/bench" --benchmark_format=json)
+
+FINANCE_LOG_LEVEL=warning "$BUILD/Application/Application" > /dev/null &
+server=$!
+trap 'kill "$server" 2> /dev/null || true' EXIT
+sleep 1
+LOAD=$("$BUILD/Benchmark/LoadGenerator" 127.0.0.1 8080 "$CONNECTIONS" "$SECONDS_PER_RUN" all "$KEEP_ALIVE")
+
+echo "{\"commit\": \"$COMMIT\", \"load\": $LOAD, \"micro\": $MICRO}" > "$RESULTS/$COMMIT.json"
+echo "$LOAD"
@@ -0,0 +1,21 @@
+#!/usr/bin/env bash
+# Measures requests/sec of the server with 1..16 I/O threads against a local Postgres seeded from MEGAADDER.sql.
+# Usage: Benchmark/scaling.sh <path to Application> <path to LoadGenerator> [connections] [seconds] [target]
+set -euo pipefail
+
+APPLICATION=${1:?path to Application}
+LOAD_GENERATOR=${2:?path to LoadGenerator}
+CONNECTIONS=${3:-128}
+SECONDS_PER_RUN=${4:-10}
+TARGET=${5:-/accounts?id=1}
+
+for threads in 1 2 4 8 16; do
+    FINANCE_THREADS=$threads FINANCE_DB_POOL_SIZE=$((threads * 2)) "$APPLICATION" > /dev/null &
+    server=$!
+    sleep 1
+    echo -n "{\"threads\": $threads, \"result\": "
+    "$LOAD_GENERATOR" 127.0.0.1 8080 "$CONNECTIONS" "$SECONDS_PER_RUN" "$TARGET" | tr -d '\n'
+    echo "}"
+    kill "$server"
+    wait "$server" 2> /dev/null || true
+done
@@ -3,6 +3,8 @@ drop table if exists income_categories cascade;
 drop table if exists bank_accounts cascade;
 drop table if exists expenses;
 drop table if exists income;
+drop table if exists expense_rollup;
+drop table if exists income_rollup;
 
 create table expense_categories
 (
@@ -16,11 +18,12 @@ create table income_categories
     name   varchar(100) not null
 );
 
+-- Amounts and totals are bigint minor units (kopecks)
 create table bank_accounts
 (
     id_account serial primary key unique,
     name       varchar(100)  not null,
-    amount     int default 0 not null
+    amount     bigint default 0 not null
 );
 
 create table expenses
@@ -28,7 +31,7 @@ create table expenses
     id_expense serial primary key unique,
     id_cat     int                                   not null,
     id_account int                                   not null,
-    amount     double precision default 0            not null,
+    amount     bigint           default 0            not null,
     date       date             default CURRENT_DATE not null,
     time       time             default CURRENT_TIME not null,
     comment    varchar(200)     default '',
@@ -41,7 +44,7 @@ create table income
     id_income  serial primary key unique,
     id_cat     int                                   not null,
     id_account int                                   not null,
-    amount     double precision default 0            not null,
+    amount     bigint           default 0            not null,
     date       date             default CURRENT_DATE not null,
     time       time             default CURRENT_TIME not null,
     comment    varchar(200)     default '',
@@ -49,6 +52,36 @@ create table income
     CONSTRAINT id_account FOREIGN KEY (id_account) REFERENCES bank_accounts (id_account) ON DELETE CASCADE
 );
 
+-- Totals per category, account and day, maintained by the server in the same transaction as the operations
+create table expense_rollup
+(
+    id_cat     int                        not null,
+    id_account int                        not null,
+    day        date                       not null,
+    total      bigint           default 0 not null,
+    count      int              default 0 not null,
+    primary key (day, id_cat, id_account),
+    FOREIGN KEY (id_cat) REFERENCES expense_categories (id_cat) ON DELETE CASCADE,
+    FOREIGN KEY (id_account) REFERENCES bank_accounts (id_account) ON DELETE CASCADE
+);
+
+create table income_rollup
+(
+    id_cat     int                        not null,
+    id_account int                        not null,
+    day        date                       not null,
+    total      bigint           default 0 not null,
+    count      int              default 0 not null,
+    primary key (day, id_cat, id_account),
+    FOREIGN KEY (id_cat) REFERENCES income_categories (id_cat) ON DELETE CASCADE,
+    FOREIGN KEY (id_account) REFERENCES bank_accounts (id_account) ON DELETE CASCADE
+);
+
+create index expenses_date_idx on expenses (date, time, id_expense);
+create index expenses_cat_date_idx on expenses (id_cat, date, time, id_expense);
+create index income_date_idx on income (date, time, id_income);
+create index income_cat_date_idx on income (id_cat, date, time, id_income);
+
 INSERT INTO bank_accounts(name)
 VALUES ('Sberbank'),
        ('Tinkoff'),
@@ -73,17 +106,27 @@ VALUES ('Other'),
        ('Dividends');
 
 INSERT INTO expenses(id_cat, id_account, amount, date, time)
-VALUES (1, 1, 5324, '2022-12-31', '12:40'),
-       (2, 2, 98, '2023-01-29', '13:31'),
-       (3, 3, 1238, '2023-01-12', '16:01'),
-       (4, 1, 7654, '2023-02-21', '22:59'),
-       (5, 2, 365, '2023-02-25', '09:32'),
-       (6, 3, 6570, '2023-03-07', '20:57');
+VALUES (1, 1, 532400, '2022-12-31', '12:40'),
+       (2, 2, 9800, '2023-01-29', '13:31'),
+       (3, 3, 123800, '2023-01-12', '16:01'),
+       (4, 1, 765400, '2023-02-21', '22:59'),
+       (5, 2, 36500, '2023-02-25', '09:32'),
+       (6, 3, 657000, '2023-03-07', '20:57');
 
 INSERT INTO income(id_cat, id_account, amount, date, time)
-VALUES (1, 1, 10000, '2022-12-23', '11:22'),
-       (2, 2, 20000, '2023-01-15', '16:31'),
-       (3, 3, 30000, '2023-01-01', '04:16'),
-       (4, 1, 40000, '2023-02-09', '15:38'),
-       (5, 2, 50000, '2023-02-17', '21:17'),
-       (6, 3, 60000, '2023-03-06', '12:42');
+VALUES (1, 1, 1000000, '2022-12-23', '11:22'),
+       (2, 2, 2000000, '2023-01-15', '16:31'),
+       (3, 3, 3000000, '2023-01-01', '04:16'),
+       (4, 1, 4000000, '2023-02-09', '15:38'),
+       (5, 2, 5000000, '2023-02-17', '21:17'),
+       (6, 3, 6000000, '2023-03-06', '12:42');
+
+INSERT INTO expense_rollup(id_cat, id_account, day, total, count)
+SELECT id_cat, id_account, date, sum(amount), count(*)
+FROM expenses
+GROUP BY id_cat, id_account, date;
+
+INSERT INTO income_rollup(id_cat, id_account, day, total, count)
+SELECT id_cat, id_account, date, sum(amount), count(*)
+FROM income
+GROUP BY id_cat, id_account, date;
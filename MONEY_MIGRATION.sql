@@ -0,0 +1,65 @@
+-- Moves a database created by the earlier MEGAADDER.sql to amounts in bigint minor units (kopecks).
+-- Run once, with the server stopped: the new server reads every stored amount as minor units.
+-- Works on a database from the first MEGAADDER.sql too, the rollup tables are created when they are missing.
+-- Everything runs in one transaction, so a failed run leaves the database as it was.
+begin;
+
+alter table bank_accounts
+    alter column amount type bigint using amount::bigint * 100;
+
+alter table expenses
+    alter column amount type bigint using round(amount * 100)::bigint;
+
+alter table income
+    alter column amount type bigint using round(amount * 100)::bigint;
+
+-- A database from before the rollups gets them here, with the keys and indexes of MEGAADDER.sql
+create table if not exists expense_rollup
+(
+    id_cat     int                        not null,
+    id_account int                        not null,
+    day        date                       not null,
+    total      bigint           default 0 not null,
+    count      int              default 0 not null,
+    primary key (day, id_cat, id_account),
+    FOREIGN KEY (id_cat) REFERENCES expense_categories (id_cat) ON DELETE CASCADE,
+    FOREIGN KEY (id_account) REFERENCES bank_accounts (id_account) ON DELETE CASCADE
+);
+
+create table if not exists income_rollup
+(
+    id_cat     int                        not null,
+    id_account int                        not null,
+    day        date                       not null,
+    total      bigint           default 0 not null,
+    count      int              default 0 not null,
+    primary key (day, id_cat, id_account),
+    FOREIGN KEY (id_cat) REFERENCES income_categories (id_cat) ON DELETE CASCADE,
+    FOREIGN KEY (id_account) REFERENCES bank_accounts (id_account) ON DELETE CASCADE
+);
+
+create index if not exists expenses_date_idx on expenses (date, time, id_expense);
+create index if not exists expenses_cat_date_idx on expenses (id_cat, date, time, id_expense);
+create index if not exists income_date_idx on income (date, time, id_income);
+create index if not exists income_cat_date_idx on income (id_cat, date, time, id_income);
+
+-- Rollups are rebuilt from the converted operations, so they match them exactly
+alter table expense_rollup
+    alter column total type bigint using 0;
+
+alter table income_rollup
+    alter column total type bigint using 0;
+
+truncate expense_rollup, income_rollup;
+
+INSERT INTO expense_rollup(id_cat, id_account, day, total, count)
+SELECT id_cat, id_account, date, sum(amount), count(*)
+FROM expenses
+GROUP BY id_cat, id_account, date;
+
+INSERT INTO income_rollup(id_cat, id_account, day, total, count)
+SELECT id_cat, id_account, date, sum(amount), count(*)
+FROM income
+GROUP BY id_cat, id_account, date;
+
+commit;
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Server/ColumnStore.h>
+#include <Server/Storage.h>
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+
+// Read model for analytics in front of another storage. Every call goes to the wrapped storage; summaries are
+// answered from a ColumnStore per ledger that is loaded at startup and updated by the writes made through here.
+// Writes by other server instances aren't seen, so it fits a single instance per database.
+class AnalyticsStorage : public Storage {
+private:
+    std::unique_ptr<Storage> storage;
+
+    // Writes are applied to the storage and the read model one at a time, so the model sees them in commit order
+    std::mutex writeMutex;
+    mutable std::shared_mutex mutex; // Guards the read model
+    std::array<ColumnStore, 2> ledgers;
+
+    ColumnStore &data(Ledger ledger) { return ledgers[static_cast<std::size_t>(ledger)]; }
+    const ColumnStore &data(Ledger ledger) const { return ledgers[static_cast<std::size_t>(ledger)]; }
+
+    static ColumnStore::Row toRow(const Operation &operation);
+    // Adds the rows of the days begin to end the model doesn't have yet, e.g. after a batch whose ids aren't known
+    void catchUp(Ledger ledger, const std::string &begin, const std::string &end);
+
+public:
+    explicit AnalyticsStorage(std::unique_ptr<Storage> storage);
+
+    std::vector<Account> listAccounts() override;
+    std::optional<Account> findAccount(int id) override;
+    int addAccount(const std::string &name, Money amount) override;
+    bool modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) override;
+    bool deleteAccount(int id) override;
+
+    std::vector<Category> listCategories(Ledger ledger) override;
+    int addCategory(Ledger ledger, const std::string &name) override;
+    bool renameCategory(Ledger ledger, int id, const std::string &name) override;
+    bool deleteCategory(Ledger ledger, int id) override;
+
+    std::optional<Operation> findOperation(Ledger ledger, int id) override;
+    int addOperation(Ledger ledger, const Operation &operation) override;
+    void addOperations(Ledger ledger, std::span<const Operation> operations) override;
+    bool modifyOperation(Ledger ledger, int id, const OperationChange &change) override;
+    bool deleteOperation(Ledger ledger, int id) override;
+
+    std::vector<Operation> listOperations(Ledger ledger, const Range &range) override;
+    void scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) override;
+
+    std::vector<SummaryRow> summary(Ledger ledger, const std::string &begin, const std::string &end, SummaryBy by,
+                                    const std::string &period) override;
+
+    void writeMetrics(ArenaString &out) const override;
+};
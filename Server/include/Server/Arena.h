@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <string>
+#include <type_traits>
+
+// Allocator over a std::pmr::memory_resource. Unlike std::pmr::polymorphic_allocator it is assignable and
+// propagates with the container, which Beast's basic_fields requires.
+template<class T>
+class ArenaAllocator {
+private:
+    std::pmr::memory_resource *resource_;
+
+    template<class U>
+    friend class ArenaAllocator;
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    ArenaAllocator() noexcept : resource_(std::pmr::get_default_resource()) {}
+    ArenaAllocator(std::pmr::memory_resource *resource) noexcept : resource_(resource) {}
+
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : resource_(other.resource_) {}
+
+    T *allocate(std::size_t n) {
+        return static_cast<T *>(resource_->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        resource_->deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    std::pmr::memory_resource *resource() const noexcept { return resource_; }
+
+    template<class U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept { return resource_ == other.resource_; }
+};
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <Server/DatabaseManager.h>
+
+#include <libpq-fe.h>
+
+#include <deque>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <boost/asio/any_completion_handler.hpp>
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/asio/async_result.hpp>
+#include <boost/asio/generic/stream_protocol.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/asio/strand.hpp>
+
+#ifndef LIBPQ_HAS_PIPELINING
+#error "AsyncDatabaseManager needs libpq 14 or newer for pipeline mode"
+#endif
+
+// Rows of a finished libpq query. Cheap to copy, all copies share one PGresult.
+class AsyncResult {
+private:
+    std::shared_ptr<PGresult> result;
+
+public:
+    AsyncResult() = default;
+    explicit AsyncResult(PGresult *result);
+
+    int size() const;
+    int columns() const;
+    std::string_view columnName(int column) const;
+    Oid columnType(int column) const;
+    bool isNull(int row, int column) const;
+    std::string_view value(int row, int column) const;
+    long affectedRows() const;
+};
+
+// The connection broke, the statement may or may not have run
+class ConnectionLost : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Second database backend: one libpq connection in non-blocking mode whose socket is waited on by the io_context,
+// so queries don't occupy a thread while Postgres works. Uses the same prepared statements as DatabaseManager.
+// The connection is in pipeline mode: statements are sent as soon as they are submitted without waiting for the
+// results of the earlier ones, so a burst of them costs about one round trip. Each is followed by a sync and runs
+// in autocommit mode, an error fails only its own statement; multi-statement transactions stay on DatabaseManager.
+// A broken connection is reset without blocking, queries submitted meanwhile wait for it.
+// Must outlive the queries submitted to it.
+class AsyncDatabaseManager {
+public:
+    using Signature = void(std::exception_ptr, AsyncResult);
+
+private:
+    struct Query {
+        std::string statement;
+        std::vector<std::string> params;
+        boost::asio::any_completion_handler<Signature> handler;
+    };
+
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+    using Socket = boost::asio::posix::stream_descriptor;
+#else
+    using Socket = boost::asio::generic::stream_protocol::socket;
+#endif
+
+    enum class State {
+        Ready,
+        Resetting, // PQresetPoll is driven by socket waits
+        Preparing, // The statements are being prepared over the new connection
+        Broken, // The reset failed, the next query tries again
+    };
+
+    boost::asio::strand<boost::asio::any_io_executor> strand;
+    std::unique_ptr<PGconn, decltype(&PQfinish)> conn;
+    Socket socket; // Wraps the libpq socket, never reads or writes by itself
+    State state = State::Ready; // Queries are sent only when ready
+    std::deque<Query> queries; // In submission order, which is also the order of their results
+    std::size_t sent = 0; // The first `sent` queries are in the pipeline
+    bool flushing = false; // Waiting until the socket takes the rest of the output
+    bool reading = false; // Waiting for results
+    AsyncResult pendingResult;
+    std::exception_ptr pendingError;
+
+    void prepare(); // Blocking, on the first connection
+    void enterPipeline();
+    void attach(); // Waits go to the current libpq socket
+    void detach(); // Also cancels the pending waits
+    bool awaitingResults() const { return sent > 0 || state == State::Preparing; }
+    void enqueue(Query &&query);
+    void sendQueued();
+    void flush();
+    void waitResult();
+    void readResults();
+    void complete(std::exception_ptr error, AsyncResult result);
+    void failFirst(std::size_t count, const std::exception_ptr &error);
+    void fail(const std::string &why); // Fails the queries in the pipeline and starts over on a new connection
+    void reconnect();
+    void pollReset(PostgresPollingStatusType polling);
+    void prepareStatements(); // Pipelined, once the reset is done
+    void broken(const std::exception_ptr &error); // Fails the queued queries
+
+public:
+    explicit AsyncDatabaseManager(const boost::asio::any_io_executor &executor);
+    ~AsyncDatabaseManager();
+
+    AsyncDatabaseManager(const AsyncDatabaseManager &) = delete;
+    AsyncDatabaseManager &operator=(const AsyncDatabaseManager &) = delete;
+
+    // Executes a prepared statement, the token may be a callback, net::use_awaitable, net::use_future, ...
+    template<class CompletionToken>
+    auto asyncExecPrepared(std::string statement, std::vector<std::string> params, CompletionToken &&token) {
+        return boost::asio::async_initiate<CompletionToken, Signature>(
+            [this](auto handler, std::string statement, std::vector<std::string> params) {
+                enqueue(Query{std::move(statement), std::move(params), std::move(handler)});
+            },
+            token, std::move(statement), std::move(params));
+    }
+};
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Dates as days since 1970-01-01 and times of day as seconds since midnight, in the text forms Postgres uses.
+// Parsing throws std::runtime_error on malformed input.
+
+int parseDate(std::string_view text); // YYYY-MM-DD
+std::string formatDate(int day);
+
+int parseTime(std::string_view text); // HH:MM or HH:MM:SS, fractions of a second are dropped
+std::string formatTime(int seconds);
+
+// First day of the day, month or year the day falls into, and the first day after that period
+int periodStart(int day, std::string_view period);
+int periodEnd(int start, std::string_view period);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Server/Encoder.h>
+
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+
+// Writes CBOR (RFC 8949). Objects and arrays have indefinite length, so a document can be streamed in parts like
+// JSON. Amounts are decimal fractions (tag 4) of minor units, dates are full-date strings (tag 1004, RFC 8943).
+class CborWriter final : public Encoder {
+private:
+    ArenaString out;
+
+    void head(unsigned major, std::uint64_t argument); // Initial byte and argument in the shortest form
+
+public:
+    explicit CborWriter(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : out(resource) {}
+
+    CborWriter &beginObject() override;
+    CborWriter &endObject() override;
+    CborWriter &beginArray() override;
+    CborWriter &endArray() override;
+
+    CborWriter &key(std::string_view name) override;
+    CborWriter &value(std::string_view text) override;
+    CborWriter &value(const char *text) { return value(std::string_view(text)); }
+    CborWriter &value(std::int64_t number) override;
+    CborWriter &value(int number) { return value(static_cast<std::int64_t>(number)); }
+    CborWriter &value(double number) override;
+    CborWriter &value(Money amount) override;
+    CborWriter &value(bool flag) override;
+    CborWriter &null() override;
+    CborWriter &date(std::string_view text) override;
+
+    std::string_view str() const override { return out; }
+    ArenaString release() override;
+    void consume() override;
+    void clear() override;
+};
+
+// Replays a CBOR document into out: maps with text keys, arrays, integers, floats, text, booleans and null.
+// Decimal fractions become amounts, other tags are dropped and their content kept; byte strings are refused.
+void decodeCbor(std::string_view data, DocumentSink &out);
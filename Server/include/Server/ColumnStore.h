@@ -0,0 +1,89 @@
+#pragma once
+
+#include <Server/Storage.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define COLUMN_STORE_SIMD_KEYS 16 // Group-bys over more keys than this accumulate in one scalar pass instead
+
+struct Totals {
+    std::int64_t total = 0; // Minor units
+    long long count = 0;
+};
+
+// Operations of one ledger as parallel columns sorted by (day, seconds, id), for range reads and aggregation.
+// A date range is found by binary search and its amounts are summed with AVX2 when the build includes the kernel
+// (FINANCE_AVX2) and the CPU supports it, otherwise by the same loop in scalar code.
+// Not synchronized, the owner locks.
+class ColumnStore {
+public:
+    // Position of a row in the sort order
+    struct Key {
+        std::int32_t day; // Days since 1970-01-01
+        std::int32_t seconds; // Since midnight
+        std::int32_t id;
+
+        auto operator<=>(const Key &) const = default;
+    };
+
+    struct Row {
+        std::int32_t id;
+        std::int32_t day;
+        std::int32_t seconds;
+        Money amount;
+        std::int32_t id_cat;
+        std::int32_t id_account;
+
+        Key key() const { return {day, seconds, id}; }
+    };
+
+private:
+    std::vector<std::int32_t> id;
+    std::vector<std::int32_t> day;
+    std::vector<std::int32_t> seconds;
+    std::vector<std::int64_t> amount; // Minor units
+    std::vector<std::int32_t> id_cat;
+    std::vector<std::int32_t> id_account;
+
+    std::unordered_map<std::int32_t, Key> keys; // id -> position, the row is found by binary search
+    std::map<std::int32_t, std::size_t> categoryRows; // Rows per key, the groups a summary goes over
+    std::map<std::int32_t, std::size_t> accountRows;
+
+    void count(std::map<std::int32_t, std::size_t> &rows, std::int32_t key, bool added);
+
+    // Defined when the build includes the AVX2 kernel (FINANCE_AVX2)
+    static bool hasAvx2(); // Checked once per process
+    static Totals sumWhereAvx2(std::span<const std::int64_t> amounts, std::span<const std::int32_t> keys,
+                               std::int32_t key);
+
+public:
+    std::size_t size() const { return id.size(); }
+    Key key(std::size_t row) const { return {day[row], seconds[row], id[row]}; }
+    Row row(std::size_t row) const;
+    std::int32_t category(std::size_t row) const { return id_cat[row]; }
+    std::size_t lowerBound(const Key &key) const; // First row not before key
+    std::size_t upperBound(const Key &key) const; // First row after key
+
+    void insert(const Row &row); // Ids already present are left as they are
+    std::optional<std::size_t> position(std::int32_t id) const; // Row of the id
+    std::optional<Row> find(std::int32_t id) const;
+    bool erase(std::int32_t id);
+    std::vector<std::int32_t> eraseAccount(std::int32_t id_account); // Returns the ids of the erased rows
+    void moveCategory(std::int32_t from, std::int32_t to);
+
+    // Days begin to end inclusive, ordered by period, then key
+    std::vector<SummaryRow> summary(int begin, int end, SummaryBy by, std::string_view period) const;
+
+    // Kernels over columns of this layout, also used by MemoryStorage
+    static Totals sumWhere(std::span<const std::int64_t> amounts, std::span<const std::int32_t> keys, std::int32_t key);
+    // days is sorted, groups are the keys to report in ascending order
+    static std::vector<SummaryRow> groupBy(std::span<const std::int32_t> days, std::span<const std::int64_t> amounts,
+                                           std::span<const std::int32_t> keys, std::span<const std::int32_t> groups,
+                                           std::string_view period);
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Server/Arena.h>
+
+#include <cstddef>
+#include <string_view>
+
+#define COMPRESSION_MIN_BYTES 1024 // Smaller bodies gain little and go out as they are
+#define COMPRESSION_GZIP_LEVEL 6
+#define COMPRESSION_ZSTD_LEVEL 3
+
+#define COMPRESSION_IDLE_STREAMS 4 // gzip streams a thread keeps for reuse
+
+struct z_stream_s;
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+
+enum class ContentEncoding { Identity, Gzip, Zstd };
+
+struct CompressionSettings {
+    bool enabled = true;
+    std::size_t minBytes = COMPRESSION_MIN_BYTES;
+    int gzipLevel = COMPRESSION_GZIP_LEVEL;
+    int zstdLevel = COMPRESSION_ZSTD_LEVEL;
+};
+
+// Compresses a response body with gzip (zlib) or, when the server is built with FINANCE_ZSTD, zstd. A body may be
+// fed in parts, e.g. the chunks of a streamed response: every part is flushed, so the client can decode it as it
+// arrives. Runs on storage threads, never on a socket's executor.
+class Compressor {
+private:
+    ContentEncoding encoding;
+    z_stream_s *gzip = nullptr; // Taken from the thread's idle streams when there is one
+    ZSTD_CCtx *zstd = nullptr;
+
+public:
+    explicit Compressor(ContentEncoding encoding);
+    ~Compressor();
+
+    Compressor(const Compressor &) = delete;
+    Compressor &operator=(const Compressor &) = delete;
+
+    // Appends the compressed form of data to out; the last part also ends the stream
+    void compress(std::string_view data, ArenaString &out, bool last);
+
+    static void configure(const CompressionSettings &settings); // Before the server starts
+    static const CompressionSettings &settings();
+
+    // Best encoding an Accept-Encoding header allows, by q-value; zstd wins a tie
+    static ContentEncoding negotiate(std::string_view acceptEncoding);
+    static bool accepts(std::string_view acceptEncoding, ContentEncoding encoding);
+    static std::string_view name(ContentEncoding encoding); // Content-Encoding value
+};
@@ -1,75 +1,68 @@
 #pragma once
 
-#include <Server/DatabaseManager.h>
+#include <Server/Exchange.h>
+#include <Server/Limits.h>
 
-#include <iostream>
-#include <cstdlib>
+#include <deque>
 #include <memory>
-#include <string>
-#include <unordered_map>
-#include <stdexcept>
-#include <boost/beast/core.hpp>
-#include <boost/beast/http.hpp>
-#include <boost/beast/version.hpp>
-#include <boost/asio/ip/tcp.hpp>
-#include <boost/config.hpp>
-#include <boost/asio.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/json_parser.hpp>
-#include <boost/lexical_cast.hpp>
+#include <optional>
+#include <vector>
 
-namespace beast = boost::beast;
-namespace http = beast::http;
-namespace net = boost::asio;
-using tcp = boost::asio::ip::tcp;
+#define PIPELINE_DEPTH 16 // Requests of a connection read ahead of the response being written
 
+// HTTP/1.1 connection with pipelining: requests are read ahead while earlier ones are handled, each in an
+// Exchange of its own, and their responses are written strictly in request order. Reads run concurrently;
+// a request that changes data waits for the ones before it and holds back the ones after it.
+// All members are used on the socket's strand only. A connection without a request in progress is closed after
+// the idle timeout, every write has a deadline of its own.
 class Connection : public std::enable_shared_from_this<Connection> {
 private:
-    tcp::socket socket;
-    http::request<http::string_body> req;
-    beast::flat_buffer buffer;
-    DatabaseManager dbManager;
+    beast::tcp_stream stream;
+    net::steady_timer idle; // Runs while no request is in progress, including the time a request takes to arrive
+    beast::flat_buffer buffer; // May already hold the next pipelined requests
+    std::optional<Exchange::Parser> parser;
+    DatabaseExecutor &dbExecutor;
+    Storage &storage;
+    ReferenceCache &referenceCache;
+    ResponseCache &responseCache;
+    const Limits &limits;
+
+    std::shared_ptr<Exchange> reading; // Exchange of the request being read
+    std::deque<std::shared_ptr<Exchange>> exchanges; // Read and not written yet, in request order
+    std::vector<std::shared_ptr<Exchange>> spare; // Written ones kept for reuse with their arenas
+    std::size_t started = 0; // The first `started` exchanges are handled or answered
+    std::size_t running = 0; // Handlers that haven't returned
+    bool exclusiveRunning = false;
+    bool writing = false;
+    bool readDone = false; // No more requests: end of stream, Connection: close or an error
+    bool failed = false; // The socket is unusable, whatever is still running is dropped
+
+    friend class Exchange;
 
 public:
-    static std::shared_ptr<Connection> create(tcp::socket &&socket);
+    static std::shared_ptr<Connection> create(tcp::socket &&socket, DatabaseExecutor &dbExecutor, Storage &storage,
+                                              ReferenceCache &referenceCache, ResponseCache &responseCache,
+                                              const Limits &limits);
     void start();
 
+    ~Connection();
+
 private:
-    explicit Connection(tcp::socket &&socket);
+    Connection(tcp::socket &&socket, DatabaseExecutor &dbExecutor, Storage &storage, ReferenceCache &referenceCache,
+               ResponseCache &responseCache, const Limits &limits);
+
+    void watchIdle(); // Starts the idle timeout when nothing is in progress
+    void onIdle(const beast::error_code &error);
 
     void asyncRead();
     void onRead(const beast::error_code &error, std::size_t bytes_transferred);
 
-    void asyncWrite(http::message_generator &&msg);
-    void onWrite(const beast::error_code &error, std::size_t, bool keep_alive);
-
-    void handleRequest();
-
-    void badRequest(beast::string_view why); // Returns a bad request response
-    void successResponse(http::status status); // Returns a successful responses
-    void jsonResponse(beast::string_view data); // Return success response with json body
-
-    void addAccount();
-    void addExpense();
-    void addIncome();
-    void addCategory();
-
-    void modifyAccount();
-    void modifyExpense();
-    void modifyIncome();
-    void modifyCategory();
-
-    void getAccount();
-    void getExpense();
-    void getIncome();
-    void getByCategory();
-
-    void deleteAccount();
-    void deleteExpense();
-    void deleteIncome();
-    void deleteCategory();
+    void dispatch(); // Starts the handlers the order of requests allows
+    void finished(std::shared_ptr<Exchange> exchange); // From any thread, once a handler returns
+    void onFinished(const std::shared_ptr<Exchange> &exchange);
 
-    std::unordered_map<std::string, std::string> parseQuery();
-    bool recordExists(int id, const std::string& tableName);
-    boost::property_tree::ptree toJson(pqxx::result &res);
+    void asyncWrite(); // Writes the next response when it is ready
+    void onWrite(const beast::error_code &error, std::size_t bytes, bool keep_alive);
+    void completed(bool keep_alive); // The response at the front is out
+    void fail(); // Closes the socket, the exchanges still running are dropped when they return
 };
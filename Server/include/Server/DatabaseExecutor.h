@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+// Runs blocking storage work on its own threads so the I/O context never waits on Postgres.
+// Jobs are expected to post their results back themselves.
+class DatabaseExecutor {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    boost::asio::thread_pool workers;
+    std::atomic<std::uint64_t> queued{0};
+    std::atomic<std::uint64_t> queueWaitNs{0};
+    // For admission control: jobs still in the queue, a moving average of the latest waits and when a job last
+    // started. The average is updated without a lock, concurrent updates may lose one another, which it tolerates.
+    std::atomic<std::int64_t> waiting{0};
+    std::atomic<std::int64_t> recentWaitNs{0};
+    std::atomic<clock::rep> lastStart{0};
+
+    void started(clock::time_point posted);
+
+public:
+    explicit DatabaseExecutor(std::size_t threads);
+
+    template<class Job>
+    void execute(Job &&job) {
+        waiting.fetch_add(1, std::memory_order_relaxed);
+        boost::asio::post(workers, [this, posted = clock::now(), job = std::forward<Job>(job)]() mutable {
+            started(posted);
+            job();
+        });
+    }
+
+    std::chrono::nanoseconds averageQueueWait() const;
+    // Whether jobs wait longer than target: by the recent waits, or because jobs are queued and none has started
+    // for that long (every thread is stuck, e.g. on a database that stopped answering)
+    bool overloaded(std::chrono::nanoseconds target) const;
+    void join();
+};
@@ -3,20 +3,30 @@
 #include <iostream>
 #include <pqxx/pqxx>
 #include <string>
+#include <vector>
 
 class DatabaseManager {
 private:
-    std::string host = "localhost";
-    std::string port = "5432";
-    std::string dbname = "finance";
-    std::string user = "postgres";
-    std::string password = "Happy2022";
-    std::string connectionString() const;
+    inline static const std::string host = "localhost";
+    inline static const std::string port = "5432";
+    inline static const std::string dbname = "finance";
+    inline static const std::string user = "postgres";
+    inline static const std::string password = "Happy2022";
 
     pqxx::connection conn;
     void prepare_statements();
 public:
+    struct Statement {
+        const char *name;
+        const char *sql;
+    };
+
     DatabaseManager();
 
+    static std::string connectionString();
+    static const std::vector<Statement> &statements(); // Prepared on every connection of both backends
+
     pqxx::connection &GetConn();
+    bool ping(); // Checks that the server still answers on this connection
+    void reconnect(); // Opens a new connection and prepares statements again
 };
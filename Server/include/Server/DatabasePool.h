@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Server/DatabaseManager.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Bounded server-wide pool of pre-connected DatabaseManager's (every one already has its statements prepared).
+// A Connection checks out one handle per request and gives it back when the request is handled.
+class DatabasePool {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct Stats {
+        std::size_t size = 0;
+        std::size_t idle = 0;
+        std::uint64_t acquired = 0;
+        std::uint64_t exhausted = 0; // acquire() found no idle connection and had to wait
+        std::uint64_t timeouts = 0;
+        std::uint64_t reconnects = 0;
+        std::chrono::nanoseconds totalWait{0};
+        std::chrono::nanoseconds maxWait{0};
+    };
+
+    class Handle {
+    private:
+        DatabasePool *pool = nullptr;
+        std::unique_ptr<DatabaseManager> manager;
+
+        friend class DatabasePool;
+        Handle(DatabasePool *pool, std::unique_ptr<DatabaseManager> &&manager);
+
+    public:
+        Handle() = default;
+        Handle(Handle &&other) noexcept = default;
+        Handle &operator=(Handle &&other) noexcept;
+        ~Handle();
+
+        DatabaseManager *operator->() const { return manager.get(); }
+        DatabaseManager &operator*() const { return *manager; }
+        explicit operator bool() const { return manager != nullptr; }
+
+        void release(); // Returns the connection to the pool
+    };
+
+    explicit DatabasePool(std::size_t size,
+                          std::chrono::milliseconds acquireTimeout = std::chrono::seconds(5),
+                          std::chrono::milliseconds healthCheckInterval = std::chrono::seconds(30));
+
+    DatabasePool(const DatabasePool &) = delete;
+    DatabasePool &operator=(const DatabasePool &) = delete;
+
+    Handle acquire(); // Blocks until a connection is free, throws on timeout
+    Stats stats() const;
+    std::size_t size() const;
+
+private:
+    struct Entry {
+        std::unique_ptr<DatabaseManager> manager;
+        clock::time_point lastUsed;
+    };
+
+    const std::chrono::milliseconds acquireTimeout;
+    const std::chrono::milliseconds healthCheckInterval;
+
+    mutable std::mutex mutex;
+    std::condition_variable available;
+    std::vector<Entry> idle;
+    std::size_t total = 0;
+    Stats counters;
+
+    void release(std::unique_ptr<DatabaseManager> &&manager);
+    void checkHealth(Entry &entry);
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Server/Arena.h>
+#include <Server/Money.h>
+
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+#define ENCODER_MAX_DEPTH 32 // Nesting a decoded request body may have
+
+class EncodingError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Formats of request and response bodies, picked by Content-Type and Accept
+enum class Format { Json, Cbor, MsgPack };
+
+// Receives a decoded CBOR or MessagePack document item by item, in document order. Strings usually view the
+// decoded data; CBOR text sent in chunks is joined into a buffer that is reused once the call returns.
+class DocumentSink {
+public:
+    virtual ~DocumentSink() = default;
+
+    virtual void beginObject() = 0;
+    virtual void endObject() = 0;
+    virtual void beginArray() = 0;
+    virtual void endArray() = 0;
+
+    virtual void key(std::string_view name) = 0;
+    virtual void value(std::string_view text) = 0;
+    virtual void value(std::int64_t number) = 0;
+    virtual void value(double number) = 0;
+    virtual void value(Money amount) = 0;
+    virtual void value(bool flag) = 0;
+    virtual void null() = 0;
+};
+
+// Writes a document of objects, arrays and scalars into one string in the arena of the request. Handlers write
+// through it whatever format the client asked for; JsonWriter, CborWriter and MsgPackWriter implement it.
+class Encoder {
+public:
+    virtual ~Encoder() = default;
+
+    virtual Encoder &beginObject() = 0;
+    virtual Encoder &endObject() = 0;
+    virtual Encoder &beginArray() = 0;
+    virtual Encoder &endArray() = 0;
+
+    virtual Encoder &key(std::string_view name) = 0;
+    virtual Encoder &value(std::string_view text) = 0;
+    Encoder &value(const char *text) { return value(std::string_view(text)); }
+    virtual Encoder &value(std::int64_t number) = 0;
+    Encoder &value(int number) { return value(static_cast<std::int64_t>(number)); }
+    virtual Encoder &value(double number) = 0;
+    virtual Encoder &value(Money amount) = 0;
+    virtual Encoder &value(bool flag) = 0;
+    virtual Encoder &null() = 0;
+    virtual Encoder &date(std::string_view text) { return value(text); } // YYYY-MM-DD, tagged where the format can
+
+    virtual std::string_view str() const = 0;
+    virtual ArenaString release() = 0;
+    // Drops the bytes written so far but stays inside the current document, for streamed responses
+    virtual void consume() = 0;
+    virtual void clear() = 0;
+
+    // Highest-quality format of an Accept header; JSON without one, for */* and on a tie. A streamed response
+    // leaves MessagePack out: its containers start with their element count, which a stream doesn't know up front
+    static Format negotiate(std::string_view accept, bool streamed = false);
+    static bool accepts(std::string_view accept, Format format); // Whether the format has a non-zero quality
+    static Format ofContentType(std::string_view contentType); // JSON for anything else
+    static std::string_view contentType(Format format);
+    // Replays a CBOR or MessagePack document into out
+    static void decode(Format format, std::string_view data, DocumentSink &out);
+};
@@ -0,0 +1,196 @@
+#pragma once
+
+#include <Server/Cbor.h>
+#include <Server/DatabaseExecutor.h>
+#include <Server/Json.h>
+#include <Server/Logger.h>
+#include <Server/Metrics.h>
+#include <Server/MsgPack.h>
+#include <Server/Query.h>
+#include <Server/ReferenceCache.h>
+#include <Server/ResponseCache.h>
+#include <Server/Router.h>
+#include <Server/Storage.h>
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <stdexcept>
+#include <variant>
+#include <boost/beast/core.hpp>
+#include <boost/beast/http.hpp>
+#include <boost/beast/version.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/config.hpp>
+#include <boost/asio.hpp>
+
+namespace beast = boost::beast;
+namespace http = beast::http;
+namespace net = boost::asio;
+using tcp = boost::asio::ip::tcp;
+
+#define ARENA_INLINE_SIZE 16384
+#define ARENA_POOL_BLOCK_LIMIT (1 << 20)
+
+class Connection;
+
+// One request of a connection and its response. Every request read ahead on a pipelined connection has its own,
+// so several can be handled at once; the Connection writes their responses back in request order.
+// Handlers run on a storage thread and leave the response here, the Connection writes it once they return.
+class Exchange : public std::enable_shared_from_this<Exchange> {
+public:
+    // Request and responses allocate from the exchange's arena
+    using Allocator = ArenaAllocator<char>;
+    using StringBody = http::basic_string_body<char, std::char_traits<char>, Allocator>;
+    using Fields = http::basic_fields<Allocator>;
+    using Request = http::request<StringBody, Fields>;
+    using Response = http::response<StringBody, Fields>;
+    using Parser = http::request_parser<StringBody, Allocator>;
+
+private:
+    using Handler = void (Exchange::*)();
+
+    // Header and body of a response sent in chunks; the serializer refers to res, so it never moves
+    struct ChunkedResponse {
+        http::response<http::buffer_body> res;
+        http::response_serializer<http::buffer_body> serializer{res};
+    };
+
+    // Memory of one request: the parser, request and response live here and everything is dropped at once
+    // when the exchange is reused. Requests that don't fit spill into a pool that keeps its blocks for the next ones.
+    std::array<std::byte, ARENA_INLINE_SIZE> arenaBuffer;
+    std::pmr::unsynchronized_pool_resource arenaOverflow{std::pmr::pool_options{0, ARENA_POOL_BLOCK_LIMIT}};
+    std::pmr::monotonic_buffer_resource arena{arenaBuffer.data(), arenaBuffer.size(), &arenaOverflow};
+
+    Connection &connection;
+    DatabaseExecutor &dbExecutor;
+    Storage &storage;
+    ReferenceCache &referenceCache;
+    ResponseCache &responseCache;
+
+    Request req;
+    Target target; // Path and query string of req, parsed once per request
+    Handler handler = nullptr; // Null when the request was answered while routing
+    bool usesDatabase = false;
+    // The request body is in bodyFormat by Content-Type, the response goes out in format as negotiated by Accept
+    Format bodyFormat = Format::Json;
+    Format format = Format::Json;
+    std::variant<std::monostate, JsonWriter, CborWriter, MsgPackWriter> encoder; // Of the response body
+
+    // Set by the handler: the response to write, or streamed once the whole response went out in chunks
+    std::optional<http::message_generator> response;
+    bool streamed = false;
+    bool done = false; // Set by the Connection once the handler returned, or at routing; then response is its own
+
+    // A GET that missed the response cache stores its body under cacheKey, unless a write got in since the lookup
+    bool caching = false;
+    std::string cacheKey;
+    ResponseCache::Generations cacheGenerations;
+
+    // For the access log and metrics
+    PhaseTimer timer;
+    std::size_t routeIndex = METRICS_MAX_ROUTES; // Position in router().table(), METRICS_MAX_ROUTES until routed
+    http::status responseStatus = http::status::ok;
+    std::size_t streamedBytes = 0;
+
+    friend class Connection;
+
+public:
+    Exchange(Connection &connection, DatabaseExecutor &dbExecutor, Storage &storage, ReferenceCache &referenceCache,
+             ResponseCache &responseCache);
+
+    Exchange(const Exchange &) = delete;
+    Exchange &operator=(const Exchange &) = delete;
+
+private:
+    // Called by the Connection on its strand
+    void reset(); // Drops the previous request and everything in the arena
+    Parser &newParser(std::optional<Parser> &parser); // Parser of the next request, allocating from the arena
+    void accept(Request &&request); // Starts timing and routes; malformed and unknown requests are answered here
+    // Answers a request that can't be read to the end with status, and closes the connection after it
+    void refuse(Request &&request, http::status status, beast::string_view why);
+    bool answered() const { return handler == nullptr; }
+    // Requests that change data run alone, so pipelined requests see the effects of the earlier ones; streamed
+    // responses are written while the handler runs, so they also wait for the responses before them
+    bool exclusive() const;
+    bool streaming() const { return handler != nullptr && req.method() == http::verb::get && streamRequested(); }
+    void run(); // Runs the handler on a storage thread or right here, then tells the Connection
+    void written(std::size_t bytes); // Records the exchange in the metrics and the access log
+
+    static const auto &router(); // Route table, defined in Exchange.cpp ahead of its uses
+    static const Route<Handler> *route(http::verb verb, std::string_view path);
+
+    void asyncWrite(http::message_generator &&msg); // Hands the response over to the Connection
+    Response makeResponse(http::status status); // Empty response in the arena with the common headers
+    void badRequest(beast::string_view why); // Returns a bad request response
+    void notAcceptable(beast::string_view why); // None of the formats the client accepts can carry the response
+    void serviceUnavailable(beast::string_view why); // Response with Retry-After for temporarily failed requests
+    void reject(const std::exception &e); // 503 when the storage is unavailable, a bad request otherwise
+    void successResponse(http::status status); // Returns a successful responses
+    Encoder &newEncoder(); // Writer of the response body in the negotiated format
+    void bodyResponse(ArenaString &&data, http::status status = http::status::ok); // Success response with a body
+    bool notModified(const ResponseCache::ETag &etag); // Answers 304 when If-None-Match lists etag
+    // 200 with a JSON body in the given encoding, validated by the hash of the body as it was before encoding
+    void encodedResponse(ArenaString &&body, std::uint64_t hash, ContentEncoding encoding);
+    ContentEncoding acceptedEncoding() const; // Negotiated from Accept-Encoding
+
+    bool cacheable() const; // GET of stored data that isn't streamed
+    bool answerFromCache(); // Builds cacheKey and answers when the cache has a fresh response
+    unsigned cacheTags() const; // Data the response of the request is built from
+    unsigned ledgerTag() const; // Operations of ledger()
+    unsigned categoryTag() const; // Categories of ledger()
+
+    void addAccount();
+    void addExpense();
+    void addIncome();
+    void addCategory();
+    void addBatch(); // Bulk load of expenses or income
+
+    void modifyAccount();
+    void modifyExpense();
+    void modifyIncome();
+    void modifyCategory();
+
+    void getAccount();
+    void getExpense();
+    void getIncome();
+    void getByCategory(); // Lists the categories when there is no query
+    void listCategories(); // Served from the reference cache
+    void getSummary(); // Totals per category or account and period
+
+    void deleteAccount();
+    void deleteExpense();
+    void deleteIncome();
+    void deleteCategory();
+
+    void getMetrics(); // Prometheus text format, answered without touching the storage
+
+    JsonObject parseBody(); // Body as an object in bodyFormat, throws when it is empty
+
+    Ledger ledger() const; // Expenses or income, from the path
+    ReferenceCache::Table categoryTable() const; // Categories of ledger()
+    // Rejects unknown id_account/id_cat from the reference cache before touching the storage
+    void checkReferences(const JsonObject &root, ReferenceCache::Table categories) const;
+    // Operations as an array of objects, or with ?shape=columns the column names once and an array per row
+    void writeOperations(Encoder &writer, std::span<const Operation> operations, const char *idKey);
+    // Without the enclosing array
+    void writeOperationRows(Encoder &writer, std::span<const Operation> operations, const char *idKey);
+    bool columnsRequested() const;
+    void beginRows(Encoder &writer, const char *idKey);
+    void endRows(Encoder &writer);
+
+    // Range queries with ?limit= and/or ?cursor= are returned page by page
+    bool pageRequested() const;
+    Page parsePage() const;
+    void writeNextPage(Encoder &writer, const std::vector<Operation> &operations, const Page &page);
+
+    // Range queries with ?stream=1 are scanned batch by batch and sent with chunked transfer encoding
+    bool streamRequested() const;
+    void streamRows(const Range &range, Encoder &writer, const char *key, const char *idKey);
+    beast::error_code writeChunk(ChunkedResponse &chunked, std::string_view data, bool last = false);
+};
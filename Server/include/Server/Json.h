@@ -0,0 +1,147 @@
+#pragma once
+
+#include <Server/Arena.h>
+#include <Server/Encoder.h>
+#include <Server/Money.h>
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory_resource>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class JsonError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Value inside a parsed document. Views the source text, nothing is copied until str() is asked for.
+// Numbers decoded from CBOR or MessagePack are held already typed instead, and have no text.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Object, Array };
+
+private:
+    enum class Decoded { None, Integer, Real, Amount };
+
+    Type type_ = Type::Null;
+    std::string_view raw; // Unquoted text of strings, source text of everything else
+    bool escaped = false;
+    Decoded decoded = Decoded::None;
+    std::int64_t integer = 0; // Of a decoded integer, minor units of a decoded amount
+    double real = 0;
+
+    template<class T>
+    T number() const;
+
+public:
+    JsonValue() = default;
+    JsonValue(Type type, std::string_view raw, bool escaped = false) : type_(type), raw(raw), escaped(escaped) {}
+    explicit JsonValue(std::int64_t number) : type_(Type::Number), decoded(Decoded::Integer), integer(number) {}
+    explicit JsonValue(double number) : type_(Type::Number), decoded(Decoded::Real), real(number) {}
+    explicit JsonValue(Money amount) : type_(Type::Number), decoded(Decoded::Amount), integer(amount.minor()) {}
+
+    Type type() const { return type_; }
+    std::string_view text() const { return raw; } // Still escaped for strings, empty for decoded numbers
+    std::string str() const;
+
+    // Numbers are accepted both as JSON numbers and as numeric strings ("amount": "1000")
+    template<class T>
+    T as() const;
+};
+
+template<> int JsonValue::as<int>() const;
+template<> long JsonValue::as<long>() const;
+template<> long long JsonValue::as<long long>() const;
+template<> double JsonValue::as<double>() const;
+template<> Money JsonValue::as<Money>() const;
+template<> bool JsonValue::as<bool>() const;
+template<> std::string JsonValue::as<std::string>() const;
+
+// Flat object of a request body, read the same way whatever the format. JSON is parsed in place over the text and
+// nested objects and arrays are kept as raw values. CBOR and MessagePack are decoded straight into typed values
+// without going through JSON text; their nested objects and arrays keep only their type.
+class JsonObject {
+private:
+    class Builder; // Collects the fields of decoded documents
+
+    std::vector<std::pair<std::string_view, JsonValue>> fields;
+    std::list<std::string> owned; // Decoded strings that don't lie in the body, e.g. CBOR text sent in chunks
+
+    friend void forEachJsonObject(std::string_view text, const std::function<void(const JsonObject &)> &f);
+    friend void forEachDecodedObject(Format format, std::string_view data,
+                                     const std::function<void(const JsonObject &)> &f);
+
+public:
+    static JsonObject parse(std::string_view text);
+    static JsonObject decode(Format format, std::string_view data); // A CBOR or MessagePack map
+
+    bool contains(std::string_view key) const;
+    const JsonValue *find(std::string_view key) const;
+
+    template<class T>
+    T get(std::string_view key) const {
+        const JsonValue *value = find(key);
+        if (value == nullptr) {
+            throw JsonError("No such node (" + std::string(key) + ")");
+        }
+        return value->as<T>();
+    }
+
+    template<class T>
+    T get(std::string_view key, const T &defaultValue) const {
+        const JsonValue *value = find(key);
+        if (value == nullptr || value->type() == JsonValue::Type::Null) {
+            return defaultValue;
+        }
+        return value->as<T>();
+    }
+
+    const std::vector<std::pair<std::string_view, JsonValue>> &items() const { return fields; }
+};
+
+// Calls f for every element of a top-level JSON array of objects, in one pass without building the array
+void forEachJsonObject(std::string_view text, const std::function<void(const JsonObject &)> &f);
+// The same for a CBOR or MessagePack array of maps
+void forEachDecodedObject(Format format, std::string_view data, const std::function<void(const JsonObject &)> &f);
+
+// Appends JSON straight into one string, commas are placed automatically.
+// The string is allocated from the given memory resource, e.g. the arena of the request.
+// Final, so code that holds a JsonWriter itself calls it without virtual dispatch.
+class JsonWriter final : public Encoder {
+private:
+    ArenaString out;
+    bool comma = false;
+
+    void separate();
+
+public:
+    explicit JsonWriter(std::pmr::memory_resource *resource = std::pmr::get_default_resource()) : out(resource) {}
+    JsonWriter(std::size_t reserve, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : out(resource) { out.reserve(reserve); }
+
+    JsonWriter &beginObject() override;
+    JsonWriter &endObject() override;
+    JsonWriter &beginArray() override;
+    JsonWriter &endArray() override;
+
+    JsonWriter &key(std::string_view name) override;
+    JsonWriter &value(std::string_view text) override; // Escaped string
+    JsonWriter &value(const char *text) { return value(std::string_view(text)); }
+    JsonWriter &value(std::int64_t number) override;
+    JsonWriter &value(int number) { return value(static_cast<std::int64_t>(number)); }
+    JsonWriter &value(double number) override; // null when not finite
+    JsonWriter &value(Money amount) override;
+    JsonWriter &value(bool flag) override;
+    JsonWriter &null() override;
+    JsonWriter &number(std::string_view text); // Already formatted number, written as is
+
+    std::string_view str() const override { return out; }
+    ArenaString release() override;
+    void consume() override; // Drops the text written so far but, unlike clear(), stays inside the current document
+    void clear() override;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+
+#define LIMITS_IDLE_TIMEOUT 30 // Seconds
+#define LIMITS_WRITE_TIMEOUT 30 // Seconds
+#define LIMITS_BODY_LIMIT (1 << 20) // Bytes, the default of Beast's request parser
+#define LIMITS_MAX_CONNECTIONS 10000
+#define LIMITS_QUEUE_TARGET 500 // Milliseconds
+#define LIMITS_RETRY_AFTER 1 // Seconds
+
+// What the server lets clients take before it closes or refuses them
+struct Limits {
+    // A connection without a request in progress is closed after idleTimeout; it covers a slow request header too
+    std::chrono::seconds idleTimeout{LIMITS_IDLE_TIMEOUT};
+    std::chrono::seconds writeTimeout{LIMITS_WRITE_TIMEOUT}; // For each write of a response to a client not reading
+    std::size_t bodyLimit = LIMITS_BODY_LIMIT; // Larger request bodies get 413
+    std::size_t maxConnections = LIMITS_MAX_CONNECTIONS; // Over it, accepted sockets get 503 and are closed
+    // Requests that need the database get 503 while its queue waits longer, 0 turns it off
+    std::chrono::milliseconds queueTarget{LIMITS_QUEUE_TARGET};
+    std::chrono::seconds retryAfter{LIMITS_RETRY_AFTER}; // Retry-After of the 503 responses
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+#define LOG_QUEUE_CAPACITY 8192 // Power of two
+#define LOG_TEXT_SIZE 256
+#define LOG_PATH_SIZE 96
+
+class JsonWriter;
+
+enum class LogLevel : std::uint8_t { Debug, Info, Warning, Error, Off };
+
+// One served request, written as a structured access-log line
+struct AccessRecord {
+    std::string_view method;
+    std::string_view path; // Without the query string, which may carry personal data
+    unsigned status;
+    std::size_t bytes;
+    std::chrono::microseconds latency;
+};
+
+// Process-wide logger. Producers format into a slot of a bounded lock-free ring buffer and return;
+// a background thread turns the records into JSON lines on stdout. When the buffer is full records are
+// dropped and counted, so logging never blocks request handling.
+class Logger {
+private:
+    struct Record {
+        std::chrono::system_clock::time_point time;
+        LogLevel level;
+        bool access;
+        std::uint16_t textSize; // Message, or the method for access records
+        std::uint16_t pathSize;
+        unsigned status;
+        std::size_t bytes;
+        std::int64_t latencyUs;
+        std::array<char, LOG_TEXT_SIZE> text;
+        std::array<char, LOG_PATH_SIZE> path;
+    };
+
+    struct Slot {
+        std::atomic<std::uint64_t> sequence;
+        Record record;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    alignas(64) std::atomic<std::uint64_t> head{0}; // Next position to write, shared by producers
+    alignas(64) std::uint64_t tail = 0; // Next position to read, only the writer thread touches it
+    alignas(64) std::atomic<std::uint64_t> droppedRecords{0};
+
+    std::atomic<LogLevel> minLevel{LogLevel::Info};
+    std::atomic<unsigned> accessSample{1};
+    std::atomic<bool> stopping{false};
+    std::thread writer;
+
+    Logger();
+
+    Record *acquire(std::uint64_t &position);
+    void publish(std::uint64_t position);
+    void run();
+    bool drain(JsonWriter &writer); // Writes out the published records, false when there were none
+
+    template<class T>
+    static void append(char *&out, char *end, const T &arg) {
+        if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, char> && !std::is_same_v<T, bool>) {
+            auto result = std::to_chars(out, end, arg);
+            out = result.ec == std::errc() ? result.ptr : out;
+        } else {
+            std::string_view text(arg);
+            std::size_t size = std::min<std::size_t>(text.size(), end - out);
+            std::copy_n(text.data(), size, out);
+            out += size;
+        }
+    }
+
+public:
+    ~Logger();
+
+    Logger(const Logger &) = delete;
+    Logger &operator=(const Logger &) = delete;
+
+    static Logger &get();
+    static LogLevel parseLevel(std::string_view name); // debug, info, warning, error or off
+
+    void configure(LogLevel level, unsigned sample); // Every sample-th successful request gets an access record
+    bool enabled(LogLevel level) const { return level >= minLevel.load(std::memory_order_relaxed); }
+    std::uint64_t dropped() const { return droppedRecords.load(std::memory_order_relaxed); }
+    void stop(); // Writes out what is queued and stops the writer thread
+
+    // Message made of the arguments (strings and numbers) written one after another
+    template<class... Args>
+    void log(LogLevel level, const Args &...args) {
+        if (!enabled(level)) {
+            return;
+        }
+        std::uint64_t position;
+        Record *record = acquire(position);
+        if (record == nullptr) {
+            return;
+        }
+        record->time = std::chrono::system_clock::now();
+        record->level = level;
+        record->access = false;
+        char *out = record->text.data();
+        (append(out, record->text.data() + record->text.size(), args), ...);
+        record->textSize = static_cast<std::uint16_t>(out - record->text.data());
+        publish(position);
+    }
+
+    void access(const AccessRecord &access); // Errors are always logged, successes are sampled
+
+    template<class... Args>
+    static void debug(const Args &...args) { get().log(LogLevel::Debug, args...); }
+    template<class... Args>
+    static void info(const Args &...args) { get().log(LogLevel::Info, args...); }
+    template<class... Args>
+    static void warning(const Args &...args) { get().log(LogLevel::Warning, args...); }
+    template<class... Args>
+    static void error(const Args &...args) { get().log(LogLevel::Error, args...); }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <Server/ColumnStore.h>
+#include <Server/Storage.h>
+
+#include <array>
+#include <map>
+#include <shared_mutex>
+#include <unordered_map>
+
+// Storage held in process memory, for load tests of the HTTP and JSON layers without Postgres.
+// Operations of a ledger are kept in a ColumnStore sorted by (date, time, id), so a date range is found by binary
+// search and read sequentially. Nothing survives a restart.
+class MemoryStorage : public Storage {
+private:
+    struct LedgerData {
+        ColumnStore columns;
+        std::unordered_map<int, std::string> comments; // Of the operations that have one
+        std::map<int, std::string> categories;
+        int nextId = 1;
+        int nextCategory = 1;
+    };
+
+    mutable std::shared_mutex mutex; // Readers share it, every change takes it exclusively
+    std::map<int, Account> accounts;
+    int nextAccount = 1;
+    std::array<LedgerData, 2> ledgers;
+
+    LedgerData &data(Ledger ledger) { return ledgers[static_cast<std::size_t>(ledger)]; }
+    const LedgerData &data(Ledger ledger) const { return ledgers[static_cast<std::size_t>(ledger)]; }
+
+    // Rows of the range: [first, last) of the columns, filtered by id_cat when the range has one
+    std::pair<std::size_t, std::size_t> bounds(const LedgerData &ledgerData, const Range &range) const;
+    void validate(Ledger ledger, const Operation &operation) const; // References must exist, like the foreign keys
+    int insert(Ledger ledger, const Operation &operation); // Without touching the balance, returns the id
+    static Operation operation(const LedgerData &ledgerData, std::size_t row);
+    void applyToBalance(Ledger ledger, int id_account, Money amount); // Negative amount reverts
+
+    void loadSample(); // Same rows as MEGAADDER.sql
+
+public:
+    explicit MemoryStorage(bool sample = true);
+
+    std::vector<Account> listAccounts() override;
+    std::optional<Account> findAccount(int id) override;
+    int addAccount(const std::string &name, Money amount) override;
+    bool modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) override;
+    bool deleteAccount(int id) override;
+
+    std::vector<Category> listCategories(Ledger ledger) override;
+    int addCategory(Ledger ledger, const std::string &name) override;
+    bool renameCategory(Ledger ledger, int id, const std::string &name) override;
+    bool deleteCategory(Ledger ledger, int id) override;
+
+    std::optional<Operation> findOperation(Ledger ledger, int id) override;
+    int addOperation(Ledger ledger, const Operation &operation) override;
+    void addOperations(Ledger ledger, std::span<const Operation> operations) override;
+    bool modifyOperation(Ledger ledger, int id, const OperationChange &change) override;
+    bool deleteOperation(Ledger ledger, int id) override;
+
+    std::vector<Operation> listOperations(Ledger ledger, const Range &range) override;
+    void scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) override;
+
+    std::vector<SummaryRow> summary(Ledger ledger, const std::string &begin, const std::string &end, SummaryBy by,
+                                    const std::string &period) override;
+
+    void writeMetrics(ArenaString &out) const override;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <Server/Arena.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string_view>
+#include <vector>
+
+#define METRICS_MAX_ROUTES 48
+#define METRICS_SUB_BUCKET_BITS 2 // 4 buckets per power of two, quantiles within 25%
+#define METRICS_MAX_MICROSECONDS_BITS 27 // Longer requests (over ~2 minutes) land in the last bucket
+#define METRICS_BUCKETS ((METRICS_MAX_MICROSECONDS_BITS - METRICS_SUB_BUCKET_BITS + 1) << METRICS_SUB_BUCKET_BITS)
+
+// Parts of a request's latency. Parse covers the target and the body, Db the wait for a database thread
+// and connection plus the queries, Serialize the JSON output and Write the socket.
+enum class Phase : std::uint8_t { Parse, Db, Serialize, Write };
+#define METRICS_PHASES 4
+
+// Splits the time of one request into phases. The request is always in exactly one phase, enter() moves
+// it to the next one, so the phases add up to the whole latency.
+class PhaseTimer {
+public:
+    using clock = std::chrono::steady_clock;
+
+private:
+    std::array<std::chrono::nanoseconds, METRICS_PHASES> spent{};
+    Phase current = Phase::Parse;
+    clock::time_point started;
+    clock::time_point since;
+
+public:
+    // Returns to the previous phase when it goes out of scope
+    class Scope {
+    private:
+        PhaseTimer &timer;
+        Phase previous;
+
+    public:
+        Scope(PhaseTimer &timer, Phase phase) : timer(timer), previous(timer.enter(phase)) {}
+        ~Scope() { timer.enter(previous); }
+
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    void start(); // Request is read, starts in Parse
+    Phase enter(Phase phase); // Returns the phase that was left
+    Scope scope(Phase phase) { return Scope(*this, phase); }
+    void stop(); // Closes the current phase
+
+    std::chrono::nanoseconds spentIn(Phase phase) const { return spent[static_cast<std::size_t>(phase)]; }
+    std::chrono::nanoseconds elapsed() const { return clock::now() - started; }
+    std::chrono::nanoseconds total() const;
+};
+
+// Method and path of a route, as labels in the exposition
+struct RouteLabel {
+    std::string_view method;
+    std::string_view path;
+};
+
+// Process-wide request metrics in the Prometheus text format.
+// Every thread records into its own shard with plain relaxed stores, nothing is shared on the request path;
+// a scrape sums the shards. Latencies go into log-linear histograms of microseconds.
+class Metrics {
+private:
+    // Written by the owning thread only, read by scrapes
+    class Counter {
+    private:
+        std::atomic<std::uint64_t> value{0};
+
+    public:
+        void add(std::uint64_t n) { value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+        std::uint64_t load() const { return value.load(std::memory_order_relaxed); }
+    };
+
+    struct Histogram {
+        std::array<Counter, METRICS_BUCKETS> buckets;
+        Counter sumMicroseconds;
+
+        void record(std::uint64_t microseconds);
+    };
+
+    struct RouteCounters {
+        std::array<Counter, 6> statuses; // By status class, 0 for anything outside 1xx-5xx
+        std::array<Histogram, METRICS_PHASES + 1> latency; // Phases, then the whole request
+    };
+
+    struct Shard {
+        std::array<RouteCounters, METRICS_MAX_ROUTES + 1> routes; // The last one is for unrouted requests
+    };
+
+    mutable std::mutex shardsMutex; // Taken when a thread records for the first time and by scrapes
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<std::int64_t> openConnections{0};
+    std::atomic<std::uint64_t> refusedConnections{0};
+    std::atomic<std::uint64_t> shedRequests{0};
+    std::atomic<std::uint64_t> timeouts{0};
+
+    Metrics() = default;
+
+    Shard &local();
+
+public:
+    Metrics(const Metrics &) = delete;
+    Metrics &operator=(const Metrics &) = delete;
+
+    static Metrics &get();
+
+    static std::size_t bucketOf(std::uint64_t microseconds);
+    static std::uint64_t bucketLimit(std::size_t bucket); // Values in the bucket are below this
+
+    // route is an index into the labels passed to write(), METRICS_MAX_ROUTES for requests that didn't route
+    void record(std::size_t route, unsigned status, const PhaseTimer &timer);
+
+    void connectionOpened() { openConnections.fetch_add(1, std::memory_order_relaxed); }
+    void connectionClosed() { openConnections.fetch_sub(1, std::memory_order_relaxed); }
+    std::int64_t connections() const { return openConnections.load(std::memory_order_relaxed); }
+    void connectionRefused() { refusedConnections.fetch_add(1, std::memory_order_relaxed); }
+    void requestShed() { shedRequests.fetch_add(1, std::memory_order_relaxed); }
+    void timedOut() { timeouts.fetch_add(1, std::memory_order_relaxed); }
+
+    void write(ArenaString &out, std::span<const RouteLabel> routes) const;
+
+    static void gauge(ArenaString &out, std::string_view name, std::string_view help, double value);
+    static void counter(ArenaString &out, std::string_view name, std::string_view help, double value);
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <charconv>
+#include <compare>
+#include <cstdint>
+
+#define MONEY_SCALE 100 // Minor units (kopecks) in a unit
+#define MONEY_MAX_CHARS 21 // Longest text toChars writes: sign, 17 digits of units, point, 2 digits
+
+// Amount of money as a whole number of minor units, so sums and differences are exact.
+// Stored in Postgres as bigint minor units; in JSON it's a decimal number of units with up to two fraction digits.
+class Money {
+private:
+    std::int64_t value = 0;
+
+    constexpr explicit Money(std::int64_t minor) : value(minor) {}
+
+public:
+    constexpr Money() = default;
+
+    static constexpr Money fromMinor(std::int64_t minor) { return Money(minor); }
+    static constexpr Money fromUnits(std::int64_t units) { return Money(units * MONEY_SCALE); }
+    constexpr std::int64_t minor() const { return value; }
+
+    constexpr Money operator-() const { return Money(-value); }
+    constexpr Money operator+(Money other) const { return Money(value + other.value); }
+    constexpr Money operator-(Money other) const { return Money(value - other.value); }
+    constexpr Money &operator+=(Money other) { value += other.value; return *this; }
+    constexpr Money &operator-=(Money other) { value -= other.value; return *this; }
+
+    constexpr auto operator<=>(const Money &) const = default;
+};
+
+// Reads -?digits[.d[d]] the way std::from_chars reads numbers: no allocation, stops at the first character that
+// doesn't belong (e.g. a third fraction digit), errc::invalid_argument without digits, result_out_of_range on overflow
+std::from_chars_result fromChars(const char *first, const char *last, Money &money);
+// Writes the shortest form: 12, 12.5, -0.05; needs at most MONEY_MAX_CHARS characters
+std::to_chars_result toChars(char *first, char *last, Money money);
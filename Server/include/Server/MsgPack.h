@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Server/Encoder.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <string_view>
+#include <vector>
+
+// Writes MessagePack. A map or array header holds the number of elements, so the writer reserves the widest header
+// and shrinks it once the container ends; a document therefore can't be consumed in parts while one is open.
+// MessagePack has no decimal type, so amounts are an extension: fixext 8 of type 1 holding the minor units as a
+// big-endian int64.
+class MsgPackWriter final : public Encoder {
+private:
+    struct Open {
+        std::size_t offset; // Of the reserved header in out
+        std::uint32_t count; // Elements, or pairs for a map
+        bool map;
+    };
+
+    ArenaString out;
+    std::vector<Open, ArenaAllocator<Open>> open; // Containers not ended yet, innermost last
+
+    void element(); // Counts an element of the innermost container
+    void string(std::string_view text); // Header and bytes, uncounted
+    void begin(bool map);
+    void end(bool map);
+
+public:
+    explicit MsgPackWriter(std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : out(resource), open(resource) {}
+
+    MsgPackWriter &beginObject() override;
+    MsgPackWriter &endObject() override;
+    MsgPackWriter &beginArray() override;
+    MsgPackWriter &endArray() override;
+
+    MsgPackWriter &key(std::string_view name) override;
+    MsgPackWriter &value(std::string_view text) override;
+    MsgPackWriter &value(const char *text) { return value(std::string_view(text)); }
+    MsgPackWriter &value(std::int64_t number) override;
+    MsgPackWriter &value(int number) { return value(static_cast<std::int64_t>(number)); }
+    MsgPackWriter &value(double number) override;
+    MsgPackWriter &value(Money amount) override;
+    MsgPackWriter &value(bool flag) override;
+    MsgPackWriter &null() override;
+
+    std::string_view str() const override { return out; }
+    ArenaString release() override;
+    void consume() override; // Only between documents, throws while a container is open
+    void clear() override;
+};
+
+// Replays a MessagePack document into out: maps with string keys, arrays, integers, floats, strings, booleans, nil
+// and amounts. Binary values and other extensions are refused.
+void decodeMsgPack(std::string_view data, DocumentSink &out);
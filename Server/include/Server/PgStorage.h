@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Server/AsyncDatabaseManager.h>
+#include <Server/DatabasePool.h>
+#include <Server/Storage.h>
+
+#include <charconv>
+#include <string>
+#include <string_view>
+
+// Money goes to and from Postgres as the bigint number of minor units, written straight into the buffers of pqxx
+namespace pqxx {
+    template<>
+    inline std::string const type_name<Money>{"Money"};
+
+    template<>
+    struct nullness<Money> : no_null<Money> {};
+
+    template<>
+    struct string_traits<Money> {
+        static constexpr bool converts_to_string{true};
+        static constexpr bool converts_from_string{true};
+
+        static char *into_buf(char *begin, char *end, const Money &value) {
+            auto [last, error] = std::to_chars(begin, end, value.minor());
+            if (error != std::errc() || last == end) {
+                throw conversion_error("Buffer too small for Money");
+            }
+            *last++ = '\0';
+            return last;
+        }
+
+        static zview to_buf(char *begin, char *end, const Money &value) {
+            return {begin, static_cast<std::size_t>(into_buf(begin, end, value) - begin - 1)};
+        }
+
+        static Money from_string(std::string_view text) {
+            std::int64_t minor = 0;
+            auto [last, error] = std::from_chars(text.data(), text.data() + text.size(), minor);
+            if (error != std::errc() || last != text.data() + text.size()) {
+                throw conversion_error("Incorrect amount: " + std::string(text));
+            }
+            return Money::fromMinor(minor);
+        }
+
+        static std::size_t size_buffer(const Money &) noexcept { return MONEY_MAX_CHARS; }
+    };
+}
+
+// Storage in Postgres through the prepared statements of DatabaseManager.
+// Every call checks a connection out of the pool for one transaction; changes to accounts and categories
+// are announced to the other server instances with ReferenceCache::notify in the same transaction.
+// Reads of a single statement may go through the libpq pipeline of an AsyncDatabaseManager instead, so the reads
+// of concurrent requests share round trips to the database and don't take connections from the pool.
+class PgStorage : public Storage {
+private:
+    DatabasePool &dbPool;
+    AsyncDatabaseManager *pipeline;
+
+    DatabasePool::Handle acquire(); // Throws StorageUnavailable when the pool is exhausted
+
+    // Name of the prepared statement for the ledger, e.g. statement(Ledger::Income, "getBy", "Category")
+    static std::string statement(Ledger ledger, std::string_view prefix, std::string_view suffix = "");
+    // Columns in table order: id_expense/id_income, id_cat, id_account, amount, date, time, comment
+    template<class Row>
+    static Operation toOperation(const Row &row);
+    // Runs a read-only statement and calls onRow for every row, which is a pqxx::row or a row of the pipeline
+    // with the same field interface. Blocks its thread until the pipeline answers, so it must not run on a thread
+    // of the io_context; reads in flight are bounded by the threads of the DatabaseExecutor.
+    template<class OnRow, class... Args>
+    void read(const std::string &name, const OnRow &onRow, const Args &...args);
+
+public:
+    explicit PgStorage(DatabasePool &dbPool, AsyncDatabaseManager *pipeline = nullptr);
+
+    std::vector<Account> listAccounts() override;
+    std::optional<Account> findAccount(int id) override;
+    int addAccount(const std::string &name, Money amount) override;
+    bool modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) override;
+    bool deleteAccount(int id) override;
+
+    std::vector<Category> listCategories(Ledger ledger) override;
+    int addCategory(Ledger ledger, const std::string &name) override;
+    bool renameCategory(Ledger ledger, int id, const std::string &name) override;
+    bool deleteCategory(Ledger ledger, int id) override;
+
+    std::optional<Operation> findOperation(Ledger ledger, int id) override;
+    int addOperation(Ledger ledger, const Operation &operation) override;
+    void addOperations(Ledger ledger, std::span<const Operation> operations) override;
+    bool modifyOperation(Ledger ledger, int id, const OperationChange &change) override;
+    bool deleteOperation(Ledger ledger, int id) override;
+
+    std::vector<Operation> listOperations(Ledger ledger, const Range &range) override;
+    void scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) override;
+
+    std::vector<SummaryRow> summary(Ledger ledger, const std::string &begin, const std::string &end, SummaryBy by,
+                                    const std::string &period) override;
+
+    void writeMetrics(ArenaString &out) const override;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#define QUERY_CAPACITY 16
+#define QUERY_ARENA_SIZE 512
+
+// Query string of a request target ("a=1&b=2") split in place into at most QUERY_CAPACITY parameters.
+// Keys and values are string_views into the target; percent-encoded values are decoded on first access
+// into a small arena that lives as long as the query and is reused by the next parse().
+class Query {
+private:
+    struct Param {
+        std::string_view key;
+        std::string_view value; // Raw until decoded
+        bool encoded = false;
+    };
+
+    mutable std::array<Param, QUERY_CAPACITY> params; // Values are replaced by their decoded form on access
+    std::size_t count = 0;
+
+    std::array<char, QUERY_ARENA_SIZE> arenaBuffer;
+    mutable std::pmr::monotonic_buffer_resource arena{arenaBuffer.data(), arenaBuffer.size()};
+
+    Param *lookup(std::string_view key) const;
+    std::string_view decode(std::string_view text) const;
+    std::string_view value(Param &param) const; // Decodes the value on first access
+
+public:
+    Query() = default;
+    Query(const Query &) = delete;
+    Query &operator=(const Query &) = delete;
+
+    bool parse(std::string_view text); // false when there are more than QUERY_CAPACITY parameters
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+    bool contains(std::string_view key) const { return lookup(key) != nullptr; }
+
+    // Decoded value of the first occurrence of key
+    std::optional<std::string_view> find(std::string_view key) const;
+    std::string_view operator[](std::string_view key) const { return find(key).value_or(std::string_view{}); }
+    // Decoded key and value of the i-th parameter, in the order of the query string
+    std::pair<std::string_view, std::string_view> at(std::size_t i) const;
+
+    // Number from a parameter; std::nullopt when it is missing or isn't a number as a whole
+    template<class T>
+    std::optional<T> get(std::string_view key) const {
+        static_assert(std::is_arithmetic_v<T>);
+        auto value = find(key);
+        if (!value) {
+            return std::nullopt;
+        }
+        T result;
+        auto [end, error] = std::from_chars(value->data(), value->data() + value->size(), result);
+        if (error != std::errc() || end != value->data() + value->size()) {
+            return std::nullopt;
+        }
+        return result;
+    }
+};
+
+// Request target split once into the path and the query string
+struct Target {
+    std::string_view path;
+    Query query;
+
+    bool parse(std::string_view target); // See Query::parse
+};
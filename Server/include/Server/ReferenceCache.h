@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Server/Storage.h>
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <pqxx/pqxx>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Process-wide copy of the small reference tables (accounts and both category tables).
+// Readers take an immutable snapshot without locking; writers copy it, change the copy and publish it.
+// Handlers update it after their transaction commits; a NOTIFY on "reference_changed" from any server
+// instance makes every instance reload it, which keeps several instances coherent.
+class ReferenceCache {
+public:
+    enum class Table { Accounts, ExpenseCategories, IncomeCategories };
+
+    struct Snapshot {
+        std::unordered_map<int, std::string> accounts; // id_account -> name
+        std::unordered_map<int, std::string> expenseCategories; // id_cat -> name
+        std::unordered_map<int, std::string> incomeCategories;
+
+        const std::unordered_map<int, std::string> &table(Table table) const;
+        std::unordered_map<int, std::string> &table(Table table);
+    };
+
+private:
+    std::atomic<std::shared_ptr<const Snapshot>> snapshot;
+    std::mutex writeMutex;
+
+    std::atomic<bool> stopping{false};
+    std::thread listener;
+
+    void listen();
+    void reload(pqxx::connection &conn);
+
+public:
+    ReferenceCache();
+    ~ReferenceCache();
+
+    ReferenceCache(const ReferenceCache &) = delete;
+    ReferenceCache &operator=(const ReferenceCache &) = delete;
+
+    void load(pqxx::connection &conn); // Initial load, also starts listening for changes from other instances
+    void load(Storage &storage); // Load from a storage no other instance shares, nothing to listen to
+
+    std::shared_ptr<const Snapshot> get() const;
+    bool contains(Table table, int id) const;
+
+    void put(Table table, int id, const std::string &name);
+    void erase(Table table, int id);
+
+    static void notify(pqxx::work &worker); // Tells other instances to reload, delivered when worker commits
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <Server/Arena.h>
+#include <Server/Compression.h>
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#define RESPONSE_CACHE_TAGS 5
+#define ETAG_SIZE 18 // 16 hex digits in quotes
+#define RESPONSE_CACHE_ENTRY_OVERHEAD 128 // Bookkeeping of an entry counted against the budget
+
+// Process-wide LRU cache of JSON bodies of GET responses, keyed by path and normalized query, within a memory budget.
+// An entry records the tags of the data it was built from; a write invalidates its tags by bumping their
+// generations, so an entry built before the write, or filled by a read that raced with it, is never served.
+// Writes by other server instances aren't seen, so it fits a single instance per database.
+class ResponseCache {
+public:
+    // Data a response is built from, as bits of a mask
+    enum Tag : unsigned {
+        Accounts = 1 << 0,
+        Expenses = 1 << 1,
+        Income = 1 << 2,
+        ExpenseCategories = 1 << 3,
+        IncomeCategories = 1 << 4,
+    };
+
+    using ETag = std::array<char, ETAG_SIZE>;
+    using Generations = std::array<std::uint64_t, RESPONSE_CACHE_TAGS>;
+
+    // The body, and the encoded form the request that filled the entry negotiated: hits are never compressed on the
+    // socket's executor, a client that doesn't accept that encoding gets the body as it is
+    struct Response {
+        std::string body;
+        std::uint64_t hash;
+        ContentEncoding encoding = ContentEncoding::Identity;
+        std::string encoded;
+    };
+
+private:
+    struct Entry {
+        std::string key;
+        unsigned tags;
+        Generations generations; // Of all tags when the read began
+        std::shared_ptr<const Response> response;
+    };
+
+    std::size_t budget; // Bytes, 0 disables the cache
+    mutable std::mutex mutex;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index; // Keys refer to the entries
+    Generations current{};
+    std::size_t used = 0;
+    std::uint64_t hits = 0;
+    std::uint64_t misses = 0;
+    std::uint64_t evictions = 0;
+
+    bool fresh(const Entry &entry) const;
+    void erase(std::list<Entry>::iterator entry);
+
+public:
+    explicit ResponseCache(std::size_t budget);
+
+    ResponseCache(const ResponseCache &) = delete;
+    ResponseCache &operator=(const ResponseCache &) = delete;
+
+    bool enabled() const { return budget > 0; }
+
+    // The cached response, or null; either way seen gets the generations to pass to put() after the read
+    std::shared_ptr<const Response> find(const std::string &key, Generations &seen);
+    // Dropped when one of tags was invalidated since seen, or when the body would take over a quarter of the budget
+    void put(const std::string &key, unsigned tags, const Generations &seen, Response &&response);
+    void invalidate(unsigned tags); // Called once a write is committed, before it is answered
+
+    void writeMetrics(ArenaString &out) const;
+
+    static std::uint64_t hash(std::string_view body);
+    // Strong validator of the body with the given hash in an encoding; encodings get different tags, as RFC 9110 asks
+    static ETag etag(std::uint64_t hash, ContentEncoding encoding);
+    // Whether an If-None-Match header lists etag; weak tags (W/"...") compare by their value as RFC 9110 requires
+    static bool matches(std::string_view ifNoneMatch, std::string_view etag);
+};
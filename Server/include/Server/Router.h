@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <boost/beast/http/verb.hpp>
+
+template<class Handler>
+struct Route {
+    boost::beast::http::verb verb;
+    std::string_view path; // Exact path, without the query string
+    Handler handler;
+    bool usesDatabase = true; // Handled on a database thread with a connection checked out
+};
+
+// Method + path table built at compile time. Routes are kept sorted, so lookup is a binary search over
+// string_views; paths are matched exactly, a prefix of a known path doesn't route anywhere.
+template<class Handler, std::size_t N>
+class Router {
+private:
+    std::array<Route<Handler>, N> routes;
+
+    static constexpr bool less(const Route<Handler> &route, boost::beast::http::verb verb, std::string_view path) {
+        return route.verb < verb || (route.verb == verb && route.path < path);
+    }
+
+public:
+    constexpr explicit Router(std::array<Route<Handler>, N> table) : routes(table) {
+        std::sort(routes.begin(), routes.end(), [](const Route<Handler> &a, const Route<Handler> &b) {
+            return less(a, b.verb, b.path);
+        });
+        for (std::size_t i = 1; i < N; ++i) {
+            if (routes[i - 1].verb == routes[i].verb && routes[i - 1].path == routes[i].path) {
+                throw std::logic_error("Duplicate route"); // Fails compilation when the router is constexpr
+            }
+        }
+    }
+
+    // The route or nullptr
+    constexpr const Route<Handler> *find(boost::beast::http::verb verb, std::string_view path) const {
+        auto it = std::partition_point(routes.begin(), routes.end(), [&](const Route<Handler> &route) {
+            return less(route, verb, path);
+        });
+        if (it == routes.end() || it->verb != verb || it->path != path) {
+            return nullptr;
+        }
+        return &*it;
+    }
+
+    // Routes in lookup order; a route's position in it is a stable index for the lifetime of the process
+    constexpr std::span<const Route<Handler>> table() const { return routes; }
+};
+
+template<class Handler, std::size_t N>
+constexpr Router<Handler, N> makeRouter(const Route<Handler> (&table)[N]) {
+    return Router<Handler, N>(std::to_array(table));
+}
@@ -1,17 +1,39 @@
 #pragma once
 
+#include <Server/AsyncDatabaseManager.h>
 #include <Server/Connection.h>
+#include <Server/DatabasePool.h>
 
+#include <memory>
+#include <string_view>
 #include <thread>
+#include <vector>
 
+// One io_context is run by `threads` threads; every Connection lives on its own strand.
+// The storage is "postgres" (through a pool of dbPoolSize connections) or "memory"; with analytics set, summaries are
+// answered from an in-process column store in front of it. With dbPipeline set, single-statement reads of the postgres
+// storage go through one libpq connection in pipeline mode instead of the pool, and the storage gets at least
+// PIPELINE_DEPTH threads, since each read waits on its thread for the result. GET responses are cached within
+// responseCacheBytes, 0 turns the cache off. Clients are held to limits.
 class Server {
 private:
-    net::io_context ioc{1};
+    std::size_t threads;
+    net::io_context ioc;
     tcp::acceptor acceptor;
-    tcp::socket socket;
+    std::unique_ptr<DatabasePool> dbPool; // Only for the postgres storage
+    std::unique_ptr<AsyncDatabaseManager> dbPipeline;
+    std::unique_ptr<Storage> storage;
+    DatabaseExecutor dbExecutor;
+    ReferenceCache referenceCache;
+    ResponseCache responseCache;
+    Limits limits;
+
+    void RefuseClient(tcp::socket &&socket); // Over the connection limit
 
 public:
-    Server(const net::ip::address &address, unsigned short port);
+    Server(const net::ip::address &address, unsigned short port, std::size_t dbPoolSize = 8, std::size_t threads = 1,
+           std::string_view storage = "postgres", bool analytics = false, bool dbPipeline = false,
+           std::size_t responseCacheBytes = 0, const Limits &limits = {});
 
     int run();
     void AcceptClient();
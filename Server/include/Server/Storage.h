@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Server/Arena.h>
+#include <Server/Money.h>
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#define OTHER_CATEGORY_ID 1 // Service category, operations of a deleted category move here
+
+// Which of the two operation tables
+enum class Ledger { Expenses, Income };
+
+struct Account {
+    int id = 0;
+    std::string name;
+    Money amount;
+};
+
+struct Category {
+    int id = 0;
+    std::string name;
+};
+
+struct Operation {
+    int id = 0; // id_expense or id_income
+    int id_cat = 0;
+    int id_account = 0;
+    Money amount;
+    std::string date; // YYYY-MM-DD
+    std::string time; // HH:MM:SS
+    std::optional<std::string> comment;
+};
+
+// Fields of an operation to change, the missing ones keep their values
+struct OperationChange {
+    std::optional<int> id_cat;
+    std::optional<int> id_account;
+    std::optional<Money> amount;
+    std::optional<std::string> date;
+    std::optional<std::string> time;
+    std::optional<std::string> comment;
+};
+
+// Keyset pagination position: rows strictly after (date, time, id) are returned
+struct Page {
+    std::string date;
+    std::string time;
+    int id;
+    int limit;
+};
+
+// Operations dated between begin and end inclusive, ordered by date, time and id
+struct Range {
+    std::string begin;
+    std::string end;
+    std::optional<int> id_cat = std::nullopt; // Only this category
+    std::optional<Page> page = std::nullopt;
+};
+
+enum class SummaryBy { Category, Account };
+
+struct SummaryRow {
+    int key; // id_cat or id_account
+    std::string period; // First day of the interval
+    Money total;
+    long long count;
+};
+
+// Thrown when the storage can't take the request right now (e.g. no free database connection), answered with 503
+class StorageUnavailable : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+// Everything the handlers read and write. Every call is one transaction; calls may come from several threads.
+// Missing rows are reported through the return value, invalid input and broken references by exceptions.
+class Storage {
+public:
+    // Receives a batch of rows, last is set on the final one (which may be empty); returning false stops the scan
+    using RowSink = std::function<bool(std::span<const Operation> rows, bool last)>;
+
+    virtual ~Storage() = default;
+
+    virtual std::vector<Account> listAccounts() = 0; // Ids and names, the amount may be left out
+    virtual std::optional<Account> findAccount(int id) = 0;
+    virtual int addAccount(const std::string &name, Money amount) = 0;
+    virtual bool modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) = 0;
+    virtual bool deleteAccount(int id) = 0; // Its operations go with it
+
+    virtual std::vector<Category> listCategories(Ledger ledger) = 0;
+    virtual int addCategory(Ledger ledger, const std::string &name) = 0;
+    virtual bool renameCategory(Ledger ledger, int id, const std::string &name) = 0;
+    virtual bool deleteCategory(Ledger ledger, int id) = 0; // Its operations move to OTHER_CATEGORY_ID
+
+    // Adding and changing operations also keeps the account balances and the summaries up to date; deleting one
+    // updates the summaries but, as it always has, leaves the balance of its account unchanged
+    virtual std::optional<Operation> findOperation(Ledger ledger, int id) = 0;
+    virtual int addOperation(Ledger ledger, const Operation &operation) = 0; // Returns the new id
+    virtual void addOperations(Ledger ledger, std::span<const Operation> operations) = 0; // All or nothing
+    virtual bool modifyOperation(Ledger ledger, int id, const OperationChange &change) = 0;
+    virtual bool deleteOperation(Ledger ledger, int id) = 0;
+
+    virtual std::vector<Operation> listOperations(Ledger ledger, const Range &range) = 0;
+    // Same rows as listOperations without a page, handed over batchRows at a time
+    virtual void scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) = 0;
+
+    // period is day, month or year; rows are ordered by period, then key
+    virtual std::vector<SummaryRow> summary(Ledger ledger, const std::string &begin, const std::string &end,
+                                            SummaryBy by, const std::string &period) = 0;
+
+    // Backend specific lines for /metrics
+    virtual void writeMetrics(ArenaString &) const {}
+};
@@ -0,0 +1,185 @@
+#include "Server/AnalyticsStorage.h"
+
+#include <Server/Calendar.h>
+#include <Server/Logger.h>
+#include <Server/Metrics.h>
+
+#include <algorithm>
+#include <climits>
+
+#define ANALYTICS_LOAD_BATCH_ROWS 10000
+#define ANALYTICS_FIRST_DAY "0001-01-01"
+#define ANALYTICS_LAST_DAY "9999-12-31"
+
+AnalyticsStorage::AnalyticsStorage(std::unique_ptr<Storage> storage) : storage(std::move(storage)) {
+    for (Ledger ledger : {Ledger::Expenses, Ledger::Income}) {
+        catchUp(ledger, ANALYTICS_FIRST_DAY, ANALYTICS_LAST_DAY);
+    }
+    Logger::info("Analytics loaded: ", data(Ledger::Expenses).size(), " expenses, ", data(Ledger::Income).size(),
+                 " income");
+}
+
+ColumnStore::Row AnalyticsStorage::toRow(const Operation &operation) {
+    return {operation.id, parseDate(operation.date), parseTime(operation.time), operation.amount, operation.id_cat,
+            operation.id_account};
+}
+
+void AnalyticsStorage::catchUp(Ledger ledger, const std::string &begin, const std::string &end) {
+    storage->scanOperations(ledger, {.begin = begin, .end = end}, ANALYTICS_LOAD_BATCH_ROWS,
+                            [&](std::span<const Operation> rows, bool) {
+                                std::unique_lock lock(mutex);
+                                for (const auto &operation : rows) {
+                                    data(ledger).insert(toRow(operation));
+                                }
+                                return true;
+                            });
+}
+
+std::vector<Account> AnalyticsStorage::listAccounts() {
+    return storage->listAccounts();
+}
+
+std::optional<Account> AnalyticsStorage::findAccount(int id) {
+    return storage->findAccount(id);
+}
+
+int AnalyticsStorage::addAccount(const std::string &name, Money amount) {
+    return storage->addAccount(name, amount);
+}
+
+bool AnalyticsStorage::modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) {
+    return storage->modifyAccount(id, name, amount);
+}
+
+bool AnalyticsStorage::deleteAccount(int id) {
+    std::lock_guard write(writeMutex);
+    if (!storage->deleteAccount(id)) {
+        return false;
+    }
+    std::unique_lock lock(mutex);
+    for (auto &ledger : ledgers) {
+        ledger.eraseAccount(id);
+    }
+    return true;
+}
+
+std::vector<Category> AnalyticsStorage::listCategories(Ledger ledger) {
+    return storage->listCategories(ledger);
+}
+
+int AnalyticsStorage::addCategory(Ledger ledger, const std::string &name) {
+    return storage->addCategory(ledger, name);
+}
+
+bool AnalyticsStorage::renameCategory(Ledger ledger, int id, const std::string &name) {
+    return storage->renameCategory(ledger, id, name);
+}
+
+bool AnalyticsStorage::deleteCategory(Ledger ledger, int id) {
+    std::lock_guard write(writeMutex);
+    if (!storage->deleteCategory(ledger, id)) {
+        return false;
+    }
+    std::unique_lock lock(mutex);
+    data(ledger).moveCategory(id, OTHER_CATEGORY_ID);
+    return true;
+}
+
+std::optional<Operation> AnalyticsStorage::findOperation(Ledger ledger, int id) {
+    return storage->findOperation(ledger, id);
+}
+
+int AnalyticsStorage::addOperation(Ledger ledger, const Operation &operation) {
+    ColumnStore::Row row = toRow(operation); // The model needs ISO dates and times, checked before any write
+    std::lock_guard write(writeMutex);
+    row.id = storage->addOperation(ledger, operation);
+    std::unique_lock lock(mutex);
+    data(ledger).insert(row);
+    return row.id;
+}
+
+void AnalyticsStorage::addOperations(Ledger ledger, std::span<const Operation> operations) {
+    if (operations.empty()) {
+        return;
+    }
+    int first = INT_MAX;
+    int last = INT_MIN;
+    for (std::size_t i = 0; i < operations.size(); ++i) {
+        try {
+            int day = parseDate(operations[i].date);
+            first = std::min(first, day);
+            last = std::max(last, day);
+        } catch (std::exception &e) {
+            throw std::runtime_error("Operation " + std::to_string(i + 1) + ": " + e.what());
+        }
+    }
+
+    std::lock_guard write(writeMutex);
+    storage->addOperations(ledger, operations);
+    // The ids of a batch aren't returned, its rows are picked up from the days it covers
+    catchUp(ledger, formatDate(first), formatDate(last));
+}
+
+bool AnalyticsStorage::modifyOperation(Ledger ledger, int id, const OperationChange &change) {
+    std::optional<int> day;
+    std::optional<int> seconds;
+    if (change.date) {
+        day = parseDate(*change.date);
+    }
+    if (change.time) {
+        seconds = parseTime(*change.time);
+    }
+    std::lock_guard write(writeMutex);
+    if (!storage->modifyOperation(ledger, id, change)) {
+        return false;
+    }
+    std::unique_lock lock(mutex);
+    ColumnStore &columns = data(ledger);
+    std::optional<ColumnStore::Row> row = columns.find(id);
+    if (row) {
+        columns.erase(id);
+        row->id_cat = change.id_cat.value_or(row->id_cat);
+        row->id_account = change.id_account.value_or(row->id_account);
+        row->amount = change.amount.value_or(row->amount);
+        row->day = day.value_or(row->day);
+        row->seconds = seconds.value_or(row->seconds);
+        columns.insert(*row);
+    }
+    return true;
+}
+
+bool AnalyticsStorage::deleteOperation(Ledger ledger, int id) {
+    std::lock_guard write(writeMutex);
+    if (!storage->deleteOperation(ledger, id)) {
+        return false;
+    }
+    std::unique_lock lock(mutex);
+    data(ledger).erase(id);
+    return true;
+}
+
+std::vector<Operation> AnalyticsStorage::listOperations(Ledger ledger, const Range &range) {
+    return storage->listOperations(ledger, range);
+}
+
+void AnalyticsStorage::scanOperations(Ledger ledger, const Range &range, std::size_t batchRows,
+                                      const RowSink &sink) {
+    storage->scanOperations(ledger, range, batchRows, sink);
+}
+
+std::vector<SummaryRow> AnalyticsStorage::summary(Ledger ledger, const std::string &begin, const std::string &end,
+                                                  SummaryBy by, const std::string &period) {
+    int first = parseDate(begin);
+    int last = parseDate(end);
+    std::shared_lock lock(mutex);
+    return data(ledger).summary(first, last, by, period);
+}
+
+void AnalyticsStorage::writeMetrics(ArenaString &out) const {
+    storage->writeMetrics(out);
+    std::shared_lock lock(mutex);
+    Metrics::gauge(out, "finance_analytics_expenses", "Expenses in the analytics read model.",
+                   static_cast<double>(data(Ledger::Expenses).size()));
+    Metrics::gauge(out, "finance_analytics_income", "Income in the analytics read model.",
+                   static_cast<double>(data(Ledger::Income).size()));
+}
@@ -0,0 +1,302 @@
+#include "Server/AsyncDatabaseManager.h"
+
+#include <stdexcept>
+#include <utility>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+
+namespace net = boost::asio;
+
+AsyncResult::AsyncResult(PGresult *result) : result(result, PQclear) {}
+
+int AsyncResult::size() const {
+    return result ? PQntuples(result.get()) : 0;
+}
+
+int AsyncResult::columns() const {
+    return result ? PQnfields(result.get()) : 0;
+}
+
+std::string_view AsyncResult::columnName(int column) const {
+    return PQfname(result.get(), column);
+}
+
+Oid AsyncResult::columnType(int column) const {
+    return PQftype(result.get(), column);
+}
+
+bool AsyncResult::isNull(int row, int column) const {
+    return PQgetisnull(result.get(), row, column) == 1;
+}
+
+std::string_view AsyncResult::value(int row, int column) const {
+    return {PQgetvalue(result.get(), row, column), static_cast<std::size_t>(PQgetlength(result.get(), row, column))};
+}
+
+long AsyncResult::affectedRows() const {
+    const char *rows = result ? PQcmdTuples(result.get()) : "";
+    return *rows ? std::stol(rows) : 0;
+}
+
+AsyncDatabaseManager::AsyncDatabaseManager(const net::any_io_executor &executor)
+    : strand(net::make_strand(executor)),
+      conn(PQconnectdb(DatabaseManager::connectionString().c_str()), PQfinish),
+      socket(executor) {
+    if (PQstatus(conn.get()) != CONNECTION_OK) {
+        throw std::runtime_error(std::string("Can't open database: ") + PQerrorMessage(conn.get()));
+    }
+    prepare();
+    enterPipeline();
+}
+
+AsyncDatabaseManager::~AsyncDatabaseManager() {
+    detach();
+}
+
+void AsyncDatabaseManager::prepare() {
+    // Statements are prepared while the connection is still blocking
+    for (const auto &statement : DatabaseManager::statements()) {
+        std::unique_ptr<PGresult, decltype(&PQclear)> res(
+            PQprepare(conn.get(), statement.name, statement.sql, 0, nullptr), PQclear);
+        if (PQresultStatus(res.get()) != PGRES_COMMAND_OK) {
+            throw std::runtime_error(PQresultErrorMessage(res.get()));
+        }
+    }
+}
+
+void AsyncDatabaseManager::enterPipeline() {
+    if (PQsetnonblocking(conn.get(), 1) != 0 || PQenterPipelineMode(conn.get()) != 1) {
+        throw std::runtime_error(PQerrorMessage(conn.get()));
+    }
+    attach();
+}
+
+void AsyncDatabaseManager::attach() {
+    detach();
+#ifdef BOOST_ASIO_HAS_POSIX_STREAM_DESCRIPTOR
+    socket.assign(PQsocket(conn.get()));
+#else
+    // A TCP socket over IPv4 or IPv6, or a Unix socket, whichever libpq connected with
+    sockaddr_storage address{};
+    int length = sizeof(address);
+    getsockname(PQsocket(conn.get()), reinterpret_cast<sockaddr *>(&address), &length);
+    socket.assign(net::generic::stream_protocol(address.ss_family, 0), PQsocket(conn.get()));
+#endif
+}
+
+void AsyncDatabaseManager::detach() {
+    // The descriptor belongs to libpq, PQfinish or PQresetStart closes it
+    if (socket.is_open()) {
+        socket.release();
+    }
+}
+
+void AsyncDatabaseManager::enqueue(Query &&query) {
+    net::post(strand, [this, query = std::move(query)]() mutable {
+        queries.push_back(std::move(query));
+        if (state == State::Ready) {
+            sendQueued();
+        } else if (state == State::Broken) {
+            reconnect();
+        }
+    });
+}
+
+void AsyncDatabaseManager::sendQueued() {
+    // Everything submitted so far goes out at once, without waiting for the results of the earlier statements
+    while (sent < queries.size()) {
+        const Query &query = queries[sent++];
+        std::vector<const char *> values;
+        values.reserve(query.params.size());
+        for (const auto &param : query.params) {
+            values.push_back(param.c_str());
+        }
+        if (!PQsendQueryPrepared(conn.get(), query.statement.c_str(), static_cast<int>(values.size()),
+                                 values.data(), nullptr, nullptr, 0)
+            || !PQpipelineSync(conn.get())) {
+            fail(PQerrorMessage(conn.get()));
+            return;
+        }
+    }
+    flush();
+}
+
+void AsyncDatabaseManager::flush() {
+    if (flushing) {
+        return; // The pending wait flushes the rest
+    }
+    int flushed = PQflush(conn.get());
+    if (flushed < 0) {
+        fail(PQerrorMessage(conn.get()));
+        return;
+    }
+    if (flushed == 1) {
+        flushing = true;
+        socket.async_wait(Socket::wait_write,
+                          net::bind_executor(strand, [this](const boost::system::error_code &error) {
+                              if (error == net::error::operation_aborted) {
+                                  return; // The connection was reset
+                              }
+                              flushing = false;
+                              error ? fail(error.message()) : flush();
+                          }));
+    }
+    if (awaitingResults()) {
+        waitResult();
+    }
+}
+
+void AsyncDatabaseManager::waitResult() {
+    if (reading) {
+        return;
+    }
+    reading = true;
+    socket.async_wait(Socket::wait_read,
+                      net::bind_executor(strand, [this](const boost::system::error_code &error) {
+                          if (error == net::error::operation_aborted) {
+                              return;
+                          }
+                          reading = false;
+                          error ? fail(error.message()) : readResults();
+                      }));
+}
+
+void AsyncDatabaseManager::readResults() {
+    if (!PQconsumeInput(conn.get())) {
+        fail(PQerrorMessage(conn.get()));
+        return;
+    }
+
+    // Results of a statement end with a null, then comes the result of its sync. The last result and the first
+    // error of a statement are kept across waits, libpq may hand them out in several reads. After a reset the
+    // statements are prepared first, under one sync of their own.
+    while (awaitingResults() && !PQisBusy(conn.get())) {
+        PGresult *res = PQgetResult(conn.get());
+        if (res == nullptr) {
+            continue;
+        }
+        auto status = PQresultStatus(res);
+        if (status == PGRES_PIPELINE_SYNC && state == State::Preparing) {
+            PQclear(res);
+            pendingResult = AsyncResult{};
+            if (auto error = std::exchange(pendingError, nullptr)) {
+                broken(error);
+                return;
+            }
+            state = State::Ready;
+            sendQueued();
+            return;
+        }
+        if (status == PGRES_PIPELINE_SYNC) {
+            PQclear(res);
+            complete(std::exchange(pendingError, nullptr), std::exchange(pendingResult, AsyncResult{}));
+            continue;
+        }
+        if (status != PGRES_TUPLES_OK && status != PGRES_COMMAND_OK && !pendingError) {
+            pendingError = std::make_exception_ptr(std::runtime_error(PQresultErrorMessage(res)));
+        }
+        pendingResult = AsyncResult(res);
+    }
+    if (awaitingResults()) {
+        waitResult();
+    }
+}
+
+void AsyncDatabaseManager::complete(std::exception_ptr error, AsyncResult result) {
+    Query query = std::move(queries.front());
+    queries.pop_front();
+    sent--;
+
+    auto executor = net::get_associated_executor(query.handler, strand);
+    net::post(executor, [handler = std::move(query.handler), error, result = std::move(result)]() mutable {
+        std::move(handler)(error, std::move(result));
+    });
+}
+
+void AsyncDatabaseManager::failFirst(std::size_t count, const std::exception_ptr &error) {
+    sent = count;
+    while (sent > 0) {
+        complete(error, AsyncResult{});
+    }
+}
+
+void AsyncDatabaseManager::fail(const std::string &why) {
+    // What happened to the statements in the pipeline is unknown, they fail and the connection starts over.
+    // Detaching the socket cancels the pending waits.
+    detach();
+    flushing = false;
+    reading = false;
+    pendingError = nullptr;
+    pendingResult = AsyncResult{};
+    auto error = std::make_exception_ptr(ConnectionLost(why));
+    failFirst(sent, error);
+    if (state == State::Ready) {
+        reconnect();
+    } else {
+        broken(error); // The new connection broke too, the next query tries again
+    }
+}
+
+void AsyncDatabaseManager::reconnect() {
+    // Queries submitted from here on wait in the queue until the statements are prepared again
+    state = State::Resetting;
+    if (!PQresetStart(conn.get())) {
+        broken(std::make_exception_ptr(ConnectionLost(PQerrorMessage(conn.get()))));
+        return;
+    }
+    pollReset(PGRES_POLLING_WRITING);
+}
+
+void AsyncDatabaseManager::pollReset(PostgresPollingStatusType polling) {
+    if (polling == PGRES_POLLING_OK) {
+        prepareStatements();
+        return;
+    }
+    if (polling == PGRES_POLLING_FAILED) {
+        broken(std::make_exception_ptr(ConnectionLost(PQerrorMessage(conn.get()))));
+        return;
+    }
+    // libpq may open another socket at any step, so the wait is set up anew each time
+    attach();
+    socket.async_wait(polling == PGRES_POLLING_READING ? Socket::wait_read : Socket::wait_write,
+                      net::bind_executor(strand, [this](const boost::system::error_code &error) {
+                          if (error == net::error::operation_aborted) {
+                              return;
+                          }
+                          detach();
+                          if (error) {
+                              broken(std::make_exception_ptr(ConnectionLost(error.message())));
+                          } else {
+                              pollReset(PQresetPoll(conn.get()));
+                          }
+                      }));
+}
+
+void AsyncDatabaseManager::prepareStatements() {
+    try {
+        enterPipeline();
+    } catch (std::exception &e) {
+        broken(std::make_exception_ptr(ConnectionLost(e.what())));
+        return;
+    }
+    state = State::Preparing;
+    for (const auto &statement : DatabaseManager::statements()) {
+        if (!PQsendPrepare(conn.get(), statement.name, statement.sql, 0, nullptr)) {
+            fail(PQerrorMessage(conn.get()));
+            return;
+        }
+    }
+    if (!PQpipelineSync(conn.get())) {
+        fail(PQerrorMessage(conn.get()));
+        return;
+    }
+    flush();
+}
+
+void AsyncDatabaseManager::broken(const std::exception_ptr &error) {
+    detach();
+    flushing = false;
+    reading = false;
+    state = State::Broken;
+    failFirst(queries.size(), error);
+}
@@ -0,0 +1,97 @@
+#include "Server/Calendar.h"
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+    int parseNumber(std::string_view text, std::size_t from, std::size_t length, const char *what) {
+        int number = 0;
+        auto part = text.substr(from, length);
+        auto [end, error] = std::from_chars(part.data(), part.data() + part.size(), number);
+        if (part.size() != length || error != std::errc() || end != part.data() + part.size()) {
+            throw std::runtime_error(std::string("Incorrect ") + what + ": " + std::string(text));
+        }
+        return number;
+    }
+
+    std::chrono::year_month_day civil(int day) {
+        return std::chrono::year_month_day{std::chrono::sys_days{std::chrono::days{day}}};
+    }
+
+    int daysOf(std::chrono::year_month_day date) {
+        return std::chrono::sys_days(date).time_since_epoch().count();
+    }
+}
+
+int parseDate(std::string_view text) {
+    if (text.size() != 10 || text[4] != '-' || text[7] != '-') {
+        throw std::runtime_error("Incorrect date: " + std::string(text));
+    }
+    std::chrono::year_month_day date{std::chrono::year{parseNumber(text, 0, 4, "date")},
+                                     std::chrono::month{static_cast<unsigned>(parseNumber(text, 5, 2, "date"))},
+                                     std::chrono::day{static_cast<unsigned>(parseNumber(text, 8, 2, "date"))}};
+    if (!date.ok()) {
+        throw std::runtime_error("Incorrect date: " + std::string(text));
+    }
+    return daysOf(date);
+}
+
+std::string formatDate(int day) {
+    auto date = civil(day);
+    char text[16];
+    std::snprintf(text, sizeof(text), "%04d-%02u-%02u", static_cast<int>(date.year()),
+                  static_cast<unsigned>(date.month()), static_cast<unsigned>(date.day()));
+    return text;
+}
+
+int parseTime(std::string_view text) {
+    if (text.size() < 5 || text[2] != ':' || (text.size() > 5 && text[5] != ':')) {
+        throw std::runtime_error("Incorrect time: " + std::string(text));
+    }
+    int hours = parseNumber(text, 0, 2, "time");
+    int minutes = parseNumber(text, 3, 2, "time");
+    int seconds = text.size() > 5 ? parseNumber(text, 6, 2, "time") : 0;
+    if (text.size() > 8 && text[8] != '.') {
+        throw std::runtime_error("Incorrect time: " + std::string(text));
+    }
+    if (hours < 0 || hours > 23 || minutes < 0 || minutes > 59 || seconds < 0 || seconds > 59) {
+        throw std::runtime_error("Incorrect time: " + std::string(text));
+    }
+    return hours * 3600 + minutes * 60 + seconds;
+}
+
+std::string formatTime(int seconds) {
+    char text[16];
+    std::snprintf(text, sizeof(text), "%02d:%02d:%02d", seconds / 3600, seconds / 60 % 60, seconds % 60);
+    return text;
+}
+
+int periodStart(int day, std::string_view period) {
+    if (period == "day") {
+        return day;
+    }
+    auto date = civil(day);
+    if (period == "month") {
+        return daysOf(date.year() / date.month() / 1);
+    }
+    if (period == "year") {
+        return daysOf(date.year() / std::chrono::January / 1);
+    }
+    throw std::runtime_error("Period must be day, month or year");
+}
+
+int periodEnd(int start, std::string_view period) {
+    if (period == "day") {
+        return start + 1;
+    }
+    auto date = civil(start);
+    if (period == "month") {
+        return daysOf(date + std::chrono::months{1});
+    }
+    if (period == "year") {
+        return daysOf(date + std::chrono::years{1});
+    }
+    throw std::runtime_error("Period must be day, month or year");
+}
@@ -0,0 +1,342 @@
+#include "Server/Cbor.h"
+
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#define CBOR_UNSIGNED 0
+#define CBOR_NEGATIVE 1
+#define CBOR_BYTES 2
+#define CBOR_TEXT 3
+#define CBOR_ARRAY 4
+#define CBOR_MAP 5
+#define CBOR_TAG 6
+#define CBOR_SIMPLE 7
+
+#define CBOR_INDEFINITE 31
+#define CBOR_BREAK '\xff'
+#define CBOR_TAG_DECIMAL 4
+#define CBOR_TAG_DATE 1004
+
+namespace {
+    template<class T>
+    void appendBigEndian(ArenaString &out, T value) {
+        char bytes[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = static_cast<char>(static_cast<std::uint64_t>(value) >> (8 * (sizeof(T) - 1 - i)));
+        }
+        out.append(bytes, sizeof(T));
+    }
+
+    class Decoder {
+    private:
+        std::string_view data;
+        std::size_t pos = 0;
+        DocumentSink &out;
+
+    public:
+        Decoder(std::string_view data, DocumentSink &out) : data(data), out(out) {}
+
+        [[noreturn]] void fail(const char *what) const {
+            throw EncodingError(std::string(what) + " at offset " + std::to_string(pos));
+        }
+
+        bool atEnd() const { return pos == data.size(); }
+
+        std::uint8_t byte() {
+            if (pos >= data.size()) {
+                fail("Unexpected end of CBOR");
+            }
+            return static_cast<std::uint8_t>(data[pos++]);
+        }
+
+        std::uint64_t bigEndian(std::size_t size) {
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                value = value << 8 | byte();
+            }
+            return value;
+        }
+
+        bool breaks() {
+            if (pos < data.size() && data[pos] == CBOR_BREAK) {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        // Argument of an initial byte; false for the indefinite length
+        bool argument(std::uint8_t info, std::uint64_t &value) {
+            if (info < 24) {
+                value = info;
+            } else if (info <= 27) {
+                value = bigEndian(std::size_t{1} << (info - 24));
+            } else if (info == CBOR_INDEFINITE) {
+                return false;
+            } else {
+                fail("Reserved CBOR argument");
+            }
+            return true;
+        }
+
+        std::string_view bytes(std::uint64_t size) {
+            if (size > data.size() - pos) {
+                fail("Unexpected end of CBOR");
+            }
+            std::string_view result = data.substr(pos, size);
+            pos += size;
+            return result;
+        }
+
+        // Text whose initial byte is read; an indefinite one is joined into joined
+        std::string_view text(std::uint8_t info, std::string &joined) {
+            std::uint64_t size;
+            if (argument(info, size)) {
+                return bytes(size);
+            }
+            joined.clear();
+            while (!breaks()) {
+                std::uint8_t initial = byte();
+                if (initial >> 5 != CBOR_TEXT || !argument(initial & 31, size)) {
+                    fail("Malformed CBOR text");
+                }
+                joined += bytes(size);
+            }
+            return joined;
+        }
+
+        std::int64_t integer() {
+            std::uint8_t initial = byte();
+            std::uint64_t value;
+            unsigned major = initial >> 5;
+            if ((major != CBOR_UNSIGNED && major != CBOR_NEGATIVE) || !argument(initial & 31, value)
+                || value > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+                fail("Expected a CBOR integer");
+            }
+            return major == CBOR_UNSIGNED ? static_cast<std::int64_t>(value) : -1 - static_cast<std::int64_t>(value);
+        }
+
+        // Tag 4 content, [exponent, mantissa]: an amount when it has at most two fraction digits
+        void decimal() {
+            if (byte() != 0x82) {
+                fail("Malformed CBOR decimal fraction");
+            }
+            std::int64_t exponent = integer();
+            std::int64_t mantissa = integer();
+            if (exponent >= -2 && exponent <= 0) {
+                std::int64_t scale = exponent == -2 ? 1 : exponent == -1 ? 10 : 100;
+                if (mantissa <= std::numeric_limits<std::int64_t>::max() / scale
+                    && mantissa >= std::numeric_limits<std::int64_t>::min() / scale) {
+                    out.value(Money::fromMinor(mantissa * scale));
+                    return;
+                }
+            }
+            out.value(static_cast<double>(mantissa) * std::pow(10.0, static_cast<double>(exponent)));
+        }
+
+        static double half(std::uint16_t bits) {
+            int exponent = (bits >> 10) & 0x1f;
+            double mantissa = bits & 0x3ff;
+            double value = exponent == 0    ? std::ldexp(mantissa, -24)
+                           : exponent == 31 ? (mantissa == 0 ? INFINITY : NAN)
+                                            : std::ldexp(mantissa + 1024, exponent - 25);
+            return bits & 0x8000 ? -value : value;
+        }
+
+        void item(int depth) {
+            if (depth > ENCODER_MAX_DEPTH) {
+                fail("CBOR is nested too deep");
+            }
+            std::uint8_t initial = byte();
+            unsigned major = initial >> 5;
+            std::uint8_t info = initial & 31;
+            std::uint64_t value = 0;
+            std::string joined;
+            switch (major) {
+                case CBOR_UNSIGNED:
+                case CBOR_NEGATIVE:
+                    if (!argument(info, value)) {
+                        fail("Malformed CBOR integer");
+                    }
+                    if (value > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+                        double magnitude = static_cast<double>(value);
+                        out.value(major == CBOR_UNSIGNED ? magnitude : -1 - magnitude);
+                    } else {
+                        auto number = static_cast<std::int64_t>(value);
+                        out.value(major == CBOR_UNSIGNED ? number : -1 - number);
+                    }
+                    return;
+                case CBOR_BYTES:
+                    fail("CBOR byte strings aren't accepted");
+                case CBOR_TEXT:
+                    out.value(text(info, joined));
+                    return;
+                case CBOR_ARRAY: {
+                    bool definite = argument(info, value);
+                    out.beginArray();
+                    for (std::uint64_t i = 0; definite ? i < value : !breaks(); ++i) {
+                        item(depth + 1);
+                    }
+                    out.endArray();
+                    return;
+                }
+                case CBOR_MAP: {
+                    bool definite = argument(info, value);
+                    out.beginObject();
+                    for (std::uint64_t i = 0; definite ? i < value : !breaks(); ++i) {
+                        std::uint8_t keyInitial = byte();
+                        if (keyInitial >> 5 != CBOR_TEXT) {
+                            fail("CBOR map keys must be text");
+                        }
+                        out.key(text(keyInitial & 31, joined));
+                        item(depth + 1);
+                    }
+                    out.endObject();
+                    return;
+                }
+                case CBOR_TAG:
+                    if (!argument(info, value)) {
+                        fail("Malformed CBOR tag");
+                    }
+                    if (value == CBOR_TAG_DECIMAL) {
+                        decimal();
+                    } else {
+                        item(depth + 1); // Dates and other tagged values are taken by their content
+                    }
+                    return;
+                default:
+                    break;
+            }
+            switch (info) {
+                case 20: out.value(false); return;
+                case 21: out.value(true); return;
+                case 22:
+                case 23: out.null(); return;
+                case 25: out.value(half(static_cast<std::uint16_t>(bigEndian(2)))); return;
+                case 26: {
+                    auto bits = static_cast<std::uint32_t>(bigEndian(4));
+                    out.value(static_cast<double>(std::bit_cast<float>(bits)));
+                    return;
+                }
+                case 27: out.value(std::bit_cast<double>(bigEndian(8))); return;
+                default: fail("Unexpected CBOR value");
+            }
+        }
+    };
+}
+
+void CborWriter::head(unsigned major, std::uint64_t argument) {
+    auto initial = static_cast<char>(major << 5);
+    if (argument < 24) {
+        out += static_cast<char>(initial | argument);
+    } else if (argument <= 0xff) {
+        out += static_cast<char>(initial | 24);
+        out += static_cast<char>(argument);
+    } else if (argument <= 0xffff) {
+        out += static_cast<char>(initial | 25);
+        appendBigEndian(out, static_cast<std::uint16_t>(argument));
+    } else if (argument <= 0xffffffff) {
+        out += static_cast<char>(initial | 26);
+        appendBigEndian(out, static_cast<std::uint32_t>(argument));
+    } else {
+        out += static_cast<char>(initial | 27);
+        appendBigEndian(out, argument);
+    }
+}
+
+CborWriter &CborWriter::beginObject() {
+    out += static_cast<char>(CBOR_MAP << 5 | CBOR_INDEFINITE);
+    return *this;
+}
+
+CborWriter &CborWriter::endObject() {
+    out += CBOR_BREAK;
+    return *this;
+}
+
+CborWriter &CborWriter::beginArray() {
+    out += static_cast<char>(CBOR_ARRAY << 5 | CBOR_INDEFINITE);
+    return *this;
+}
+
+CborWriter &CborWriter::endArray() {
+    out += CBOR_BREAK;
+    return *this;
+}
+
+CborWriter &CborWriter::key(std::string_view name) {
+    return value(name);
+}
+
+CborWriter &CborWriter::value(std::string_view text) {
+    head(CBOR_TEXT, text.size());
+    out += text;
+    return *this;
+}
+
+CborWriter &CborWriter::value(std::int64_t number) {
+    if (number >= 0) {
+        head(CBOR_UNSIGNED, static_cast<std::uint64_t>(number));
+    } else {
+        head(CBOR_NEGATIVE, ~static_cast<std::uint64_t>(number)); // -1 - number without overflow
+    }
+    return *this;
+}
+
+CborWriter &CborWriter::value(double number) {
+    // Single precision when it holds the value exactly
+    auto single = static_cast<float>(number);
+    if (static_cast<double>(single) == number) {
+        out += static_cast<char>(CBOR_SIMPLE << 5 | 26);
+        appendBigEndian(out, std::bit_cast<std::uint32_t>(single));
+    } else {
+        out += static_cast<char>(CBOR_SIMPLE << 5 | 27);
+        appendBigEndian(out, std::bit_cast<std::uint64_t>(number));
+    }
+    return *this;
+}
+
+CborWriter &CborWriter::value(Money amount) {
+    head(CBOR_TAG, CBOR_TAG_DECIMAL);
+    head(CBOR_ARRAY, 2);
+    value(std::int64_t{-2}); // Exponent of the minor units
+    return value(amount.minor());
+}
+
+CborWriter &CborWriter::value(bool flag) {
+    out += static_cast<char>(CBOR_SIMPLE << 5 | (flag ? 21 : 20));
+    return *this;
+}
+
+CborWriter &CborWriter::null() {
+    out += static_cast<char>(CBOR_SIMPLE << 5 | 22);
+    return *this;
+}
+
+CborWriter &CborWriter::date(std::string_view text) {
+    head(CBOR_TAG, CBOR_TAG_DATE);
+    return value(text);
+}
+
+ArenaString CborWriter::release() {
+    return std::move(out);
+}
+
+void CborWriter::consume() {
+    out.clear();
+}
+
+void CborWriter::clear() {
+    out.clear();
+}
+
+void decodeCbor(std::string_view data, DocumentSink &out) {
+    Decoder decoder(data, out);
+    decoder.item(0);
+    if (!decoder.atEnd()) {
+        decoder.fail("Unexpected data after CBOR document");
+    }
+}
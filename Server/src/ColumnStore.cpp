@@ -0,0 +1,206 @@
+#include "Server/ColumnStore.h"
+
+#include <Server/Calendar.h>
+
+#include <algorithm>
+#include <ranges>
+
+ColumnStore::Row ColumnStore::row(std::size_t row) const {
+    return {id[row], day[row], seconds[row], Money::fromMinor(amount[row]), id_cat[row], id_account[row]};
+}
+
+std::size_t ColumnStore::lowerBound(const Key &key) const {
+    auto rows = std::views::iota(std::size_t{0}, size());
+    auto found = std::ranges::partition_point(rows, [&](std::size_t row) { return this->key(row) < key; });
+    return static_cast<std::size_t>(found - rows.begin());
+}
+
+std::size_t ColumnStore::upperBound(const Key &key) const {
+    auto rows = std::views::iota(std::size_t{0}, size());
+    auto found = std::ranges::partition_point(rows, [&](std::size_t row) { return !(key < this->key(row)); });
+    return static_cast<std::size_t>(found - rows.begin());
+}
+
+void ColumnStore::count(std::map<std::int32_t, std::size_t> &rows, std::int32_t key, bool added) {
+    if (added) {
+        rows[key]++;
+    } else if (--rows[key] == 0) {
+        rows.erase(key);
+    }
+}
+
+void ColumnStore::insert(const Row &row) {
+    Key key = row.key();
+    if (!keys.emplace(row.id, key).second) {
+        return;
+    }
+    // New operations are usually the latest ones and go to the end
+    std::size_t at = size() == 0 || this->key(size() - 1) < key ? size() : lowerBound(key);
+    auto offset = static_cast<std::ptrdiff_t>(at);
+    id.insert(id.begin() + offset, row.id);
+    day.insert(day.begin() + offset, row.day);
+    seconds.insert(seconds.begin() + offset, row.seconds);
+    amount.insert(amount.begin() + offset, row.amount.minor());
+    id_cat.insert(id_cat.begin() + offset, row.id_cat);
+    id_account.insert(id_account.begin() + offset, row.id_account);
+    count(categoryRows, row.id_cat, true);
+    count(accountRows, row.id_account, true);
+}
+
+std::optional<std::size_t> ColumnStore::position(std::int32_t id) const {
+    auto found = keys.find(id);
+    if (found == keys.end()) {
+        return std::nullopt;
+    }
+    return lowerBound(found->second);
+}
+
+std::optional<ColumnStore::Row> ColumnStore::find(std::int32_t id) const {
+    std::optional<std::size_t> at = position(id);
+    if (!at) {
+        return std::nullopt;
+    }
+    return row(*at);
+}
+
+bool ColumnStore::erase(std::int32_t id) {
+    auto found = keys.find(id);
+    if (found == keys.end()) {
+        return false;
+    }
+    std::size_t row = lowerBound(found->second);
+    keys.erase(found);
+    count(categoryRows, id_cat[row], false);
+    count(accountRows, id_account[row], false);
+
+    auto offset = static_cast<std::ptrdiff_t>(row);
+    this->id.erase(this->id.begin() + offset);
+    day.erase(day.begin() + offset);
+    seconds.erase(seconds.begin() + offset);
+    amount.erase(amount.begin() + offset);
+    id_cat.erase(id_cat.begin() + offset);
+    id_account.erase(id_account.begin() + offset);
+    return true;
+}
+
+std::vector<std::int32_t> ColumnStore::eraseAccount(std::int32_t account) {
+    // One pass over all columns, the order of the kept rows doesn't change
+    std::vector<std::int32_t> erased;
+    std::size_t kept = 0;
+    for (std::size_t row = 0; row < size(); ++row) {
+        if (id_account[row] == account) {
+            erased.push_back(id[row]);
+            keys.erase(id[row]);
+            count(categoryRows, id_cat[row], false);
+            continue;
+        }
+        id[kept] = id[row];
+        day[kept] = day[row];
+        seconds[kept] = seconds[row];
+        amount[kept] = amount[row];
+        id_cat[kept] = id_cat[row];
+        id_account[kept] = id_account[row];
+        kept++;
+    }
+    id.resize(kept);
+    day.resize(kept);
+    seconds.resize(kept);
+    amount.resize(kept);
+    id_cat.resize(kept);
+    id_account.resize(kept);
+    accountRows.erase(account);
+    return erased;
+}
+
+void ColumnStore::moveCategory(std::int32_t from, std::int32_t to) {
+    auto moved = categoryRows.find(from);
+    if (moved == categoryRows.end()) {
+        return;
+    }
+    std::replace(id_cat.begin(), id_cat.end(), from, to);
+    categoryRows[to] += moved->second;
+    categoryRows.erase(from);
+}
+
+std::vector<SummaryRow> ColumnStore::summary(int begin, int end, SummaryBy by, std::string_view period) const {
+    auto first = std::lower_bound(day.begin(), day.end(), begin) - day.begin();
+    auto last = std::max(first, std::upper_bound(day.begin(), day.end(), end) - day.begin());
+    const auto &keys = by == SummaryBy::Category ? id_cat : id_account;
+    const auto &rows = by == SummaryBy::Category ? categoryRows : accountRows;
+
+    std::vector<std::int32_t> groups;
+    groups.reserve(rows.size());
+    for (const auto &[key, count] : rows) {
+        groups.push_back(key);
+    }
+    auto range = [first, last](const auto &column) {
+        return std::span(column.data() + first, static_cast<std::size_t>(last - first));
+    };
+    return groupBy(range(day), range(amount), range(keys), groups, period);
+}
+
+Totals ColumnStore::sumWhere(std::span<const std::int64_t> amounts, std::span<const std::int32_t> keys,
+                             std::int32_t key) {
+#ifdef FINANCE_AVX2
+    if (hasAvx2()) {
+        return sumWhereAvx2(amounts, keys, key);
+    }
+#endif
+    Totals totals;
+    for (std::size_t row = 0; row < amounts.size(); ++row) {
+        if (keys[row] == key) {
+            totals.total += amounts[row];
+            totals.count++;
+        }
+    }
+    return totals;
+}
+
+std::vector<SummaryRow> ColumnStore::groupBy(std::span<const std::int32_t> days, std::span<const std::int64_t> amounts,
+                                             std::span<const std::int32_t> keys, std::span<const std::int32_t> groups,
+                                             std::string_view period) {
+    std::vector<SummaryRow> rows;
+    if (days.empty()) {
+        periodStart(0, period); // Still rejects an unknown period
+        return rows;
+    }
+
+    // Periods are consecutive runs of the sorted days, each is cut out by binary search
+    std::size_t first = 0;
+    while (first < days.size()) {
+        int start = periodStart(days[first], period);
+        auto last = static_cast<std::size_t>(
+            std::lower_bound(days.begin() + static_cast<std::ptrdiff_t>(first), days.end(), periodEnd(start, period))
+            - days.begin());
+        auto part = [first, last](auto column) { return column.subspan(first, last - first); };
+        std::string label = formatDate(start);
+
+        if (groups.size() <= COLUMN_STORE_SIMD_KEYS) {
+            // One vectorized pass per key reads the period from cache and beats scattering into a table
+            for (std::int32_t key : groups) {
+                Totals totals = sumWhere(part(amounts), part(keys), key);
+                if (totals.count > 0) {
+                    rows.push_back({key, label, Money::fromMinor(totals.total), totals.count});
+                }
+            }
+        } else {
+            // Totals of the period go into a table parallel to groups, a row finds its group by binary search
+            std::vector<Totals> totals(groups.size());
+            for (std::size_t row = first; row < last; ++row) {
+                auto group = std::lower_bound(groups.begin(), groups.end(), keys[row]);
+                if (group != groups.end() && *group == keys[row]) {
+                    Totals &found = totals[static_cast<std::size_t>(group - groups.begin())];
+                    found.total += amounts[row];
+                    found.count++;
+                }
+            }
+            for (std::size_t group = 0; group < groups.size(); ++group) {
+                if (totals[group].count > 0) {
+                    rows.push_back({groups[group], label, Money::fromMinor(totals[group].total), totals[group].count});
+                }
+            }
+        }
+        first = last;
+    }
+    return rows;
+}
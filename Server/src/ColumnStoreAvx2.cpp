@@ -0,0 +1,71 @@
+#include "Server/ColumnStore.h"
+
+#ifdef FINANCE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Only the kernel is built for AVX2, the rest of the library keeps the baseline instruction set.
+// MSVC emits the intrinsics without a target attribute.
+#if defined(__GNUC__) || defined(__clang__)
+#define AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define AVX2_TARGET
+#endif
+
+bool ColumnStore::hasAvx2() {
+    static const bool supported = [] {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_cpu_supports("avx2") != 0;
+#else
+        // CPUID.7.0:EBX bit 5, and the OS saving the YMM registers (OSXSAVE, XCR0 bits 1 and 2)
+        int info[4];
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#endif
+    }();
+    return supported;
+}
+
+AVX2_TARGET Totals ColumnStore::sumWhereAvx2(std::span<const std::int64_t> amounts, std::span<const std::int32_t> keys,
+                                             std::int32_t key) {
+    // Eight rows per step in two independent chains: the 32-bit key compares are widened to 64-bit masks that
+    // select the amounts, and subtracting a mask (-1) counts the row
+    const std::int64_t *amount = amounts.data();
+    const std::int32_t *row = keys.data();
+    std::size_t size = amounts.size();
+    const __m128i wanted = _mm_set1_epi32(key);
+    __m256i total[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    __m256i count[2] = {_mm256_setzero_si256(), _mm256_setzero_si256()};
+    std::size_t at = 0;
+    for (; at + 8 <= size; at += 8) {
+        for (int half = 0; half < 2; ++half) {
+            std::size_t first = at + 4 * half;
+            __m128i match = _mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(row + first)), wanted);
+            __m256i mask = _mm256_cvtepi32_epi64(match);
+            __m256i amounts4 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(amount + first));
+            total[half] = _mm256_add_epi64(total[half], _mm256_and_si256(amounts4, mask));
+            count[half] = _mm256_sub_epi64(count[half], mask);
+        }
+    }
+    alignas(32) std::int64_t totalLanes[4];
+    alignas(32) long long countLanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i *>(totalLanes), _mm256_add_epi64(total[0], total[1]));
+    _mm256_store_si256(reinterpret_cast<__m256i *>(countLanes), _mm256_add_epi64(count[0], count[1]));
+    Totals totals;
+    totals.total = totalLanes[0] + totalLanes[1] + totalLanes[2] + totalLanes[3];
+    totals.count = countLanes[0] + countLanes[1] + countLanes[2] + countLanes[3];
+    for (; at < size; ++at) {
+        if (row[at] == key) {
+            totals.total += amount[at];
+            totals.count++;
+        }
+    }
+    return totals;
+}
+#endif
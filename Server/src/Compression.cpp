@@ -0,0 +1,193 @@
+#include "Server/Compression.h"
+
+#include <algorithm>
+#include <charconv>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+#ifdef FINANCE_ZSTD
+#include <zstd.h>
+#endif
+
+#define COMPRESSION_OUTPUT_STEP 16384
+
+namespace {
+    CompressionSettings current;
+
+    // Starting deflate allocates and clears a few hundred KB, which costs more than compressing a small response,
+    // so finished streams are reset and kept for the next response of the thread
+    struct IdleStreams {
+        std::vector<std::unique_ptr<z_stream>> streams;
+
+        ~IdleStreams() {
+            for (auto &stream : streams) {
+                deflateEnd(stream.get());
+            }
+        }
+    };
+    thread_local IdleStreams idleStreams;
+
+    bool equalNoCase(std::string_view a, std::string_view b) {
+        return std::ranges::equal(a, b, [](char x, char y) { return (x | 0x20) == (y | 0x20); });
+    }
+
+    std::string_view trim(std::string_view text) {
+        auto first = text.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    }
+
+    // q-value of an encoding in an Accept-Encoding header: its own entry, else the one of "*", else 0
+    double quality(std::string_view header, ContentEncoding encoding) {
+        double wildcard = 0;
+        while (!header.empty()) {
+            auto end = header.find(',');
+            std::string_view element = header.substr(0, end);
+            header = end == std::string_view::npos ? std::string_view{} : header.substr(end + 1);
+
+            auto semicolon = element.find(';');
+            std::string_view coding = trim(element.substr(0, semicolon));
+            double q = 1;
+            if (semicolon != std::string_view::npos) {
+                std::string_view param = trim(element.substr(semicolon + 1));
+                if (param.size() > 2 && (param[0] | 0x20) == 'q' && param[1] == '=') {
+                    std::from_chars(param.data() + 2, param.data() + param.size(), q);
+                }
+            }
+
+            bool matches = equalNoCase(coding, Compressor::name(encoding))
+                           || (encoding == ContentEncoding::Gzip && equalNoCase(coding, "x-gzip"));
+            if (matches) {
+                return q;
+            }
+            if (coding == "*") {
+                wildcard = q;
+            }
+        }
+        return wildcard;
+    }
+}
+
+Compressor::Compressor(ContentEncoding encoding) : encoding(encoding) {
+    if (encoding == ContentEncoding::Gzip) {
+        if (!idleStreams.streams.empty()) {
+            gzip = idleStreams.streams.back().release();
+            idleStreams.streams.pop_back();
+            return;
+        }
+        auto stream = std::make_unique<z_stream>();
+        // 16 added to the window bits asks zlib for the gzip wrapper instead of the zlib one
+        if (deflateInit2(stream.get(), current.gzipLevel, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("Can't start gzip compression");
+        }
+        gzip = stream.release();
+    } else if (encoding == ContentEncoding::Zstd) {
+#ifdef FINANCE_ZSTD
+        zstd = ZSTD_createCCtx();
+        if (zstd == nullptr) {
+            throw std::runtime_error("Can't start zstd compression");
+        }
+        ZSTD_CCtx_setParameter(zstd, ZSTD_c_compressionLevel, current.zstdLevel);
+#else
+        throw std::runtime_error("The server is built without zstd");
+#endif
+    }
+}
+
+Compressor::~Compressor() {
+    if (gzip != nullptr) {
+        std::unique_ptr<z_stream> stream(gzip);
+        if (idleStreams.streams.size() < COMPRESSION_IDLE_STREAMS && deflateReset(stream.get()) == Z_OK) {
+            idleStreams.streams.push_back(std::move(stream));
+        } else {
+            deflateEnd(stream.get());
+        }
+    }
+#ifdef FINANCE_ZSTD
+    ZSTD_freeCCtx(zstd);
+#endif
+}
+
+void Compressor::compress(std::string_view data, ArenaString &out, bool last) {
+    if (encoding == ContentEncoding::Gzip) {
+        gzip->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+        gzip->avail_in = static_cast<uInt>(data.size());
+        int flush = last ? Z_FINISH : Z_SYNC_FLUSH;
+        while (true) {
+            std::size_t size = out.size();
+            std::size_t step = std::max<std::size_t>(deflateBound(gzip, gzip->avail_in), COMPRESSION_OUTPUT_STEP);
+            out.resize(size + step);
+            gzip->next_out = reinterpret_cast<Bytef *>(out.data() + size);
+            gzip->avail_out = static_cast<uInt>(step);
+            int result = deflate(gzip, flush);
+            out.resize(size + step - gzip->avail_out);
+            if (result == Z_STREAM_ERROR) {
+                throw std::runtime_error("gzip compression failed");
+            }
+            // A flush is complete once deflate leaves room in the output, the end once it says so
+            if (last ? result == Z_STREAM_END : gzip->avail_out != 0) {
+                return;
+            }
+        }
+    }
+#ifdef FINANCE_ZSTD
+    if (encoding == ContentEncoding::Zstd) {
+        ZSTD_inBuffer input{data.data(), data.size(), 0};
+        std::size_t remaining;
+        do {
+            std::size_t size = out.size();
+            std::size_t step = std::max<std::size_t>(ZSTD_compressBound(data.size()), COMPRESSION_OUTPUT_STEP);
+            out.resize(size + step);
+            ZSTD_outBuffer output{out.data() + size, step, 0};
+            remaining = ZSTD_compressStream2(zstd, &output, &input, last ? ZSTD_e_end : ZSTD_e_flush);
+            out.resize(size + output.pos);
+            if (ZSTD_isError(remaining)) {
+                throw std::runtime_error(std::string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+            }
+        } while (remaining != 0);
+        return;
+    }
+#endif
+    out.append(data);
+}
+
+void Compressor::configure(const CompressionSettings &settings) {
+    current = settings;
+}
+
+const CompressionSettings &Compressor::settings() {
+    return current;
+}
+
+ContentEncoding Compressor::negotiate(std::string_view acceptEncoding) {
+    if (!current.enabled || acceptEncoding.empty()) {
+        return ContentEncoding::Identity;
+    }
+    double gzipQuality = quality(acceptEncoding, ContentEncoding::Gzip);
+#ifdef FINANCE_ZSTD
+    double zstdQuality = quality(acceptEncoding, ContentEncoding::Zstd);
+    if (zstdQuality > 0 && zstdQuality >= gzipQuality) {
+        return ContentEncoding::Zstd;
+    }
+#endif
+    return gzipQuality > 0 ? ContentEncoding::Gzip : ContentEncoding::Identity;
+}
+
+bool Compressor::accepts(std::string_view acceptEncoding, ContentEncoding encoding) {
+    return encoding == ContentEncoding::Identity || quality(acceptEncoding, encoding) > 0;
+}
+
+std::string_view Compressor::name(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            return "gzip";
+        case ContentEncoding::Zstd:
+            return "zstd";
+        default:
+            return "identity";
+    }
+}
@@ -0,0 +1,40 @@
+#include "Server/DatabaseExecutor.h"
+
+DatabaseExecutor::DatabaseExecutor(std::size_t threads) : workers(threads) {
+    lastStart.store(clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+void DatabaseExecutor::started(clock::time_point posted) {
+    auto now = clock::now();
+    std::int64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(now - posted).count();
+    waiting.fetch_sub(1, std::memory_order_relaxed);
+    queued.fetch_add(1, std::memory_order_relaxed);
+    queueWaitNs.fetch_add(static_cast<std::uint64_t>(wait), std::memory_order_relaxed);
+    // Each wait moves the average an eighth of the way, so it follows a spike within a few dozen jobs
+    std::int64_t recent = recentWaitNs.load(std::memory_order_relaxed);
+    recentWaitNs.store(recent + (wait - recent) / 8, std::memory_order_relaxed);
+    lastStart.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+}
+
+std::chrono::nanoseconds DatabaseExecutor::averageQueueWait() const {
+    auto count = queued.load(std::memory_order_relaxed);
+    if (count == 0) {
+        return std::chrono::nanoseconds{0};
+    }
+    return std::chrono::nanoseconds(queueWaitNs.load(std::memory_order_relaxed) / count);
+}
+
+bool DatabaseExecutor::overloaded(std::chrono::nanoseconds target) const {
+    if (waiting.load(std::memory_order_relaxed) <= 0) {
+        return false; // A free thread takes the next job right away
+    }
+    if (std::chrono::nanoseconds(recentWaitNs.load(std::memory_order_relaxed)) > target) {
+        return true;
+    }
+    clock::time_point last{clock::duration(lastStart.load(std::memory_order_relaxed))};
+    return clock::now() - last > target;
+}
+
+void DatabaseExecutor::join() {
+    workers.join();
+}
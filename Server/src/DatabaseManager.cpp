@@ -1,59 +1,159 @@
 #include "Server/DatabaseManager.h"
 
+#include <Server/Logger.h>
+
 DatabaseManager::DatabaseManager() : conn(connectionString().c_str()) {
     if (!conn.is_open()) {
-        std::cerr << "Can't open database\n";
+        Logger::error("Can't open database");
     } else {
         prepare_statements();
     }
 }
 
-std::string DatabaseManager::connectionString() const {
+std::string DatabaseManager::connectionString() {
     std::string connectionString =
         "host=" + host + " port=" + port + " dbname=" + dbname + " user=" + user + " password=" + password;
     return connectionString;
 }
 
+const std::vector<DatabaseManager::Statement> &DatabaseManager::statements() {
+    static const std::vector<Statement> statements{
+        {"findAccount", "SELECT * FROM bank_accounts WHERE id_account=$1"},
+        {"findIncomeCategory", "SELECT * FROM income_categories WHERE id_cat=$1"},
+        {"findExpenseCategory", "SELECT * FROM expense_categories WHERE id_cat=$1"},
+        {"findIncome", "SELECT * FROM income WHERE id_income=$1"},
+        {"findExpense", "SELECT * FROM expenses WHERE id_expense=$1"},
+
+        {"listAccounts", "SELECT id_account, name FROM bank_accounts"},
+        {"listIncomeCategories", "SELECT id_cat, name FROM income_categories"},
+        {"listExpenseCategories", "SELECT id_cat, name FROM expense_categories"},
+
+        {"decreaseAccountAmount", "UPDATE bank_accounts SET amount=amount-$1 WHERE id_account=$2"},
+        {"increaseAccountAmount", "UPDATE bank_accounts SET amount=amount+$1 WHERE id_account=$2"},
+        {"changeAccountAmounts",
+         "UPDATE bank_accounts AS b SET amount=b.amount+d.delta "
+         "FROM unnest($1::int[], $2::bigint[]) AS d(id_account, delta) WHERE b.id_account=d.id_account"},
+
+        {"addAccount", "INSERT INTO bank_accounts (name, amount) VALUES($1, $2) RETURNING id_account"},
+        {"addIncomeCategory", "INSERT INTO income_categories (name) VALUES($1) RETURNING id_cat"},
+        {"addExpenseCategory", "INSERT INTO expense_categories (name) VALUES($1) RETURNING id_cat"},
+        {"addIncome",
+         "INSERT INTO income (id_cat, id_account, amount, date, time, comment) VALUES($1, $2, $3, $4, $5, $6) "
+         "RETURNING id_income"},
+        {"addExpense",
+         "INSERT INTO expenses (id_cat, id_account, amount, date, time, comment) VALUES($1, $2, $3, $4, $5, $6) "
+         "RETURNING id_expense"},
+
+        {"modifyAccount", "UPDATE bank_accounts SET name=$1, amount=$2 WHERE id_account=$3"},
+        {"modifyIncomeCategory", "UPDATE income_categories SET name=$1 WHERE id_cat=$2"},
+        {"modifyExpenseCategory", "UPDATE expense_categories SET name=$1 WHERE id_cat=$2"},
+        {"modifyIncome",
+         "UPDATE income SET id_cat=$1, id_account=$2, amount=$3, date=$4, time=$5, comment=$6 WHERE id_income=$7"},
+        {"modifyExpense",
+         "UPDATE expenses SET id_cat=$1, id_account=$2, amount=$3, date=$4, time=$5, comment=$6 WHERE id_expense=$7"},
+
+        {"getByIncomeCategory",
+         "SELECT * FROM income WHERE id_cat=$1 AND date BETWEEN $2 AND $3 ORDER BY date, time, id_income"},
+        {"getByExpenseCategory",
+         "SELECT * FROM expenses WHERE id_cat=$1 AND date BETWEEN $2 AND $3 ORDER BY date, time, id_expense"},
+        {"getIncome", "SELECT * FROM income WHERE date BETWEEN $1 AND $2 ORDER BY date, time, id_income"},
+        {"getExpense", "SELECT * FROM expenses WHERE date BETWEEN $1 AND $2 ORDER BY date, time, id_expense"},
+
+        // Keyset pagination: rows after the (date, time, id) cursor of the previous page
+        {"getByIncomeCategoryPage",
+         "SELECT * FROM income WHERE id_cat=$1 AND date BETWEEN $2 AND $3 AND (date, time, id_income) > ($4::date, $5::time, $6::int) "
+         "ORDER BY date, time, id_income LIMIT $7"},
+        {"getByExpenseCategoryPage",
+         "SELECT * FROM expenses WHERE id_cat=$1 AND date BETWEEN $2 AND $3 AND (date, time, id_expense) > ($4::date, $5::time, $6::int) "
+         "ORDER BY date, time, id_expense LIMIT $7"},
+        {"getIncomePage",
+         "SELECT * FROM income WHERE date BETWEEN $1 AND $2 AND (date, time, id_income) > ($3::date, $4::time, $5::int) "
+         "ORDER BY date, time, id_income LIMIT $6"},
+        {"getExpensePage",
+         "SELECT * FROM expenses WHERE date BETWEEN $1 AND $2 AND (date, time, id_expense) > ($3::date, $4::time, $5::int) "
+         "ORDER BY date, time, id_expense LIMIT $6"},
+
+        {"deleteAccount", "DELETE FROM bank_accounts WHERE id_account=$1"},
+        {"deleteIncomeCategory", "DELETE FROM income_categories WHERE id_cat=$1"},
+        {"deleteExpenseCategory", "DELETE FROM expense_categories WHERE id_cat=$1"},
+        {"changeIncomeCategoryOther", "UPDATE income SET id_cat=1 WHERE id_cat=$1"},
+        {"changeExpenseCategoryOther", "UPDATE expenses SET id_cat=1 WHERE id_cat=$1"},
+        {"deleteIncome", "DELETE FROM income WHERE id_income=$1 RETURNING id_cat, id_account, amount, date"},
+        {"deleteExpense", "DELETE FROM expenses WHERE id_expense=$1 RETURNING id_cat, id_account, amount, date"},
+
+        // Per-day rollups, changed in the same transaction as the operations themselves
+        {"changeIncomeRollup",
+         "INSERT INTO income_rollup (id_cat, id_account, day, total, count) VALUES($1, $2, $3::date, $4, $5) "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=income_rollup.total+EXCLUDED.total, count=income_rollup.count+EXCLUDED.count"},
+        {"changeExpenseRollup",
+         "INSERT INTO expense_rollup (id_cat, id_account, day, total, count) VALUES($1, $2, $3::date, $4, $5) "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=expense_rollup.total+EXCLUDED.total, count=expense_rollup.count+EXCLUDED.count"},
+        {"changeIncomeRollups",
+         "INSERT INTO income_rollup (id_cat, id_account, day, total, count) "
+         "SELECT id_cat, id_account, day, sum(amount), count(*) "
+         "FROM unnest($1::int[], $2::int[], $3::date[], $4::bigint[]) AS d(id_cat, id_account, day, amount) "
+         "GROUP BY id_cat, id_account, day "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=income_rollup.total+EXCLUDED.total, count=income_rollup.count+EXCLUDED.count"},
+        {"changeExpenseRollups",
+         "INSERT INTO expense_rollup (id_cat, id_account, day, total, count) "
+         "SELECT id_cat, id_account, day, sum(amount), count(*) "
+         "FROM unnest($1::int[], $2::int[], $3::date[], $4::bigint[]) AS d(id_cat, id_account, day, amount) "
+         "GROUP BY id_cat, id_account, day "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=expense_rollup.total+EXCLUDED.total, count=expense_rollup.count+EXCLUDED.count"},
+        // Merges the rollup rows of a deleted category into the service one, the old rows go with the category
+        {"changeIncomeRollupOther",
+         "INSERT INTO income_rollup (id_cat, id_account, day, total, count) "
+         "SELECT 1, id_account, day, total, count FROM income_rollup WHERE id_cat=$1 "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=income_rollup.total+EXCLUDED.total, count=income_rollup.count+EXCLUDED.count"},
+        {"changeExpenseRollupOther",
+         "INSERT INTO expense_rollup (id_cat, id_account, day, total, count) "
+         "SELECT 1, id_account, day, total, count FROM expense_rollup WHERE id_cat=$1 "
+         "ON CONFLICT (day, id_cat, id_account) DO UPDATE "
+         "SET total=expense_rollup.total+EXCLUDED.total, count=expense_rollup.count+EXCLUDED.count"},
+
+        // Summaries over the rollups, $3 is the period: day, month or year
+        {"getIncomeSummaryByCategory",
+         "SELECT id_cat, date_trunc($3, day::timestamp)::date AS period, sum(total) AS total, sum(count) AS count "
+         "FROM income_rollup WHERE day BETWEEN $1 AND $2 GROUP BY 1, 2 HAVING sum(count) > 0 ORDER BY 2, 1"},
+        {"getExpenseSummaryByCategory",
+         "SELECT id_cat, date_trunc($3, day::timestamp)::date AS period, sum(total) AS total, sum(count) AS count "
+         "FROM expense_rollup WHERE day BETWEEN $1 AND $2 GROUP BY 1, 2 HAVING sum(count) > 0 ORDER BY 2, 1"},
+        {"getIncomeSummaryByAccount",
+         "SELECT id_account, date_trunc($3, day::timestamp)::date AS period, sum(total) AS total, sum(count) AS count "
+         "FROM income_rollup WHERE day BETWEEN $1 AND $2 GROUP BY 1, 2 HAVING sum(count) > 0 ORDER BY 2, 1"},
+        {"getExpenseSummaryByAccount",
+         "SELECT id_account, date_trunc($3, day::timestamp)::date AS period, sum(total) AS total, sum(count) AS count "
+         "FROM expense_rollup WHERE day BETWEEN $1 AND $2 GROUP BY 1, 2 HAVING sum(count) > 0 ORDER BY 2, 1"},
+    };
+    return statements;
+}
+
 void DatabaseManager::prepare_statements() {
-    conn.prepare("findAccount", "SELECT * FROM bank_accounts WHERE id_account=$1");
-    conn.prepare("findIncomeCategory", "SELECT * FROM income_categories WHERE id_cat=$1");
-    conn.prepare("findExpenseCategory", "SELECT * FROM expense_categories WHERE id_cat=$1");
-    conn.prepare("findIncome", "SELECT * FROM income WHERE id_income=$1");
-    conn.prepare("findExpense", "SELECT * FROM expenses WHERE id_expense=$1");
-
-    conn.prepare("decreaseAccountAmount", "UPDATE bank_accounts SET amount=amount-$1 WHERE id_account=$2");
-    conn.prepare("increaseAccountAmount", "UPDATE bank_accounts SET amount=amount+$1 WHERE id_account=$2");
-
-    conn.prepare("addAccount", "INSERT INTO bank_accounts (name, amount) VALUES($1, $2)");
-    conn.prepare("addIncomeCategory", "INSERT INTO income_categories (name) VALUES($1)");
-    conn.prepare("addExpenseCategory", "INSERT INTO expense_categories (name) VALUES($1)");
-    conn.prepare("addIncome",
-                 "INSERT INTO income (id_cat, id_account, amount, date, time, comment) VALUES($1, $2, $3, $4, $5, $6)");
-    conn.prepare("addExpense",
-                 "INSERT INTO expenses (id_cat, id_account, amount, date, time, comment) VALUES($1, $2, $3, $4, $5, $6)");
-
-    conn.prepare("modifyAccount", "UPDATE bank_accounts SET name=$1, amount=$2 WHERE id_account=$3");
-    conn.prepare("modifyIncomeCategory", "UPDATE income_categories SET name=$1 WHERE id_cat=$2");
-    conn.prepare("modifyExpenseCategory", "UPDATE expense_categories SET name=$1 WHERE id_cat=$2");
-    conn.prepare("modifyIncome",
-                 "UPDATE income SET id_cat=$1, id_account=$2, amount=$3, date=$4, time=$5, comment=$6 WHERE id_income=$7");
-    conn.prepare("modifyExpense",
-                 "UPDATE expenses SET id_cat=$1, id_account=$2, amount=$3, date=$4, time=$5, comment=$6 WHERE id_expense=$7");
-
-    conn.prepare("getByIncomeCategory", "SELECT * FROM income WHERE id_cat=$1 AND date BETWEEN $2 AND $3 ORDER BY date ASC");
-    conn.prepare("getByExpenseCategory", "SELECT * FROM expenses WHERE id_cat=$1 AND date BETWEEN $2 AND $3 ORDER BY date ASC");
-    conn.prepare("getIncome", "SELECT * FROM income WHERE date BETWEEN $1 AND $2 ORDER BY date ASC");
-    conn.prepare("getExpense", "SELECT * FROM expenses WHERE date BETWEEN $1 AND $2 ORDER BY date ASC");
-
-    conn.prepare("deleteAccount", "DELETE FROM bank_accounts WHERE id_account=$1");
-    conn.prepare("deleteIncomeCategory", "DELETE FROM income_categories WHERE id_cat=$1");
-    conn.prepare("deleteExpenseCategory", "DELETE FROM expense_categories WHERE id_cat=$1");
-    conn.prepare("changeIncomeCategoryOther", "UPDATE income SET id_cat=1 WHERE id_cat=$1");
-    conn.prepare("changeExpenseCategoryOther", "UPDATE expenses SET id_cat=1 WHERE id_cat=$1");
-    conn.prepare("deleteIncome", "DELETE FROM income WHERE id_income=$1");
-    conn.prepare("deleteExpense", "DELETE FROM expenses WHERE id_expense=$1");
+    for (const auto &statement : statements()) {
+        conn.prepare(statement.name, statement.sql);
+    }
 }
 
 pqxx::connection &DatabaseManager::GetConn() {
     return conn;
-}
\ No newline at end of file
+}
+
+bool DatabaseManager::ping() {
+    try {
+        pqxx::nontransaction worker(conn);
+        worker.exec("SELECT 1");
+        return true;
+    } catch (const pqxx::broken_connection &) {
+        return false;
+    }
+}
+
+void DatabaseManager::reconnect() {
+    conn = pqxx::connection(connectionString().c_str());
+    prepare_statements();
+}
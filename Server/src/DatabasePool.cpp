@@ -0,0 +1,103 @@
+#include "Server/DatabasePool.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+DatabasePool::Handle::Handle(DatabasePool *pool, std::unique_ptr<DatabaseManager> &&manager)
+    : pool(pool), manager(std::move(manager)) {}
+
+DatabasePool::Handle &DatabasePool::Handle::operator=(Handle &&other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        manager = std::move(other.manager);
+    }
+    return *this;
+}
+
+DatabasePool::Handle::~Handle() {
+    release();
+}
+
+void DatabasePool::Handle::release() {
+    if (manager) {
+        pool->release(std::move(manager));
+    }
+}
+
+DatabasePool::DatabasePool(std::size_t size,
+                           std::chrono::milliseconds acquireTimeout,
+                           std::chrono::milliseconds healthCheckInterval)
+    : acquireTimeout(acquireTimeout), healthCheckInterval(healthCheckInterval) {
+    if (size == 0) {
+        throw std::invalid_argument("Database pool size must be positive");
+    }
+    idle.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        idle.push_back({std::make_unique<DatabaseManager>(), clock::now()});
+    }
+    total = size;
+    counters.size = size;
+}
+
+DatabasePool::Handle DatabasePool::acquire() {
+    auto started = clock::now();
+    Entry entry;
+    {
+        std::unique_lock lock(mutex);
+        if (idle.empty()) {
+            counters.exhausted++;
+            if (!available.wait_for(lock, acquireTimeout, [this] { return !idle.empty(); })) {
+                counters.timeouts++;
+                throw std::runtime_error("Database pool exhausted");
+            }
+        }
+        entry = std::move(idle.back());
+        idle.pop_back();
+
+        auto waited = clock::now() - started;
+        counters.acquired++;
+        counters.totalWait += waited;
+        counters.maxWait = std::max<std::chrono::nanoseconds>(counters.maxWait, waited);
+    }
+
+    try {
+        checkHealth(entry);
+    } catch (...) {
+        release(std::move(entry.manager));
+        throw;
+    }
+    return Handle{this, std::move(entry.manager)};
+}
+
+void DatabasePool::checkHealth(Entry &entry) {
+    // Dropped connections are always reopened, idle ones are pinged before being handed out
+    bool healthy = entry.manager->GetConn().is_open();
+    if (healthy && clock::now() - entry.lastUsed > healthCheckInterval) {
+        healthy = entry.manager->ping();
+    }
+    if (!healthy) {
+        entry.manager->reconnect();
+        std::lock_guard lock(mutex);
+        counters.reconnects++;
+    }
+}
+
+void DatabasePool::release(std::unique_ptr<DatabaseManager> &&manager) {
+    {
+        std::lock_guard lock(mutex);
+        idle.push_back({std::move(manager), clock::now()});
+    }
+    available.notify_one();
+}
+
+DatabasePool::Stats DatabasePool::stats() const {
+    std::lock_guard lock(mutex);
+    Stats result = counters;
+    result.idle = idle.size();
+    return result;
+}
+
+std::size_t DatabasePool::size() const {
+    return total;
+}
@@ -0,0 +1,127 @@
+#include "Server/Encoder.h"
+
+#include <Server/Cbor.h>
+#include <Server/MsgPack.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+
+namespace {
+    bool equalNoCase(std::string_view a, std::string_view b) {
+        return std::ranges::equal(a, b, [](char x, char y) { return (x | 0x20) == (y | 0x20); });
+    }
+
+    std::string_view trim(std::string_view text) {
+        auto first = text.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            return {};
+        }
+        return text.substr(first, text.find_last_not_of(" \t") - first + 1);
+    }
+
+    // Media types of a format; the first is the one responses are sent with
+    std::array<std::string_view, 3> mediaTypes(Format format) {
+        switch (format) {
+            case Format::Cbor:
+                return {"application/cbor"};
+            case Format::MsgPack:
+                return {"application/msgpack", "application/x-msgpack", "application/vnd.msgpack"};
+            default:
+                return {"application/json"};
+        }
+    }
+
+    bool isMediaType(std::string_view type, Format format) {
+        return std::ranges::any_of(mediaTypes(format), [type](std::string_view known) {
+            return !known.empty() && equalNoCase(type, known);
+        });
+    }
+
+    // q-value of a format in an Accept header: its own entry, else with wildcards application/* and then */*, else 0
+    double quality(std::string_view header, Format format, bool wildcards) {
+        double own = -1;
+        double application = -1;
+        double any = -1;
+        while (!header.empty()) {
+            auto end = header.find(',');
+            std::string_view element = header.substr(0, end);
+            header = end == std::string_view::npos ? std::string_view{} : header.substr(end + 1);
+
+            auto semicolon = element.find(';');
+            std::string_view type = trim(element.substr(0, semicolon));
+            double q = 1;
+            while (semicolon != std::string_view::npos) {
+                element = element.substr(semicolon + 1);
+                semicolon = element.find(';');
+                std::string_view param = trim(element.substr(0, semicolon));
+                if (param.size() > 2 && (param[0] | 0x20) == 'q' && param[1] == '=') {
+                    std::from_chars(param.data() + 2, param.data() + param.size(), q);
+                }
+            }
+
+            if (isMediaType(type, format)) {
+                own = std::max(own, q);
+            } else if (equalNoCase(type, "application/*")) {
+                application = q;
+            } else if (type == "*/*") {
+                any = q;
+            }
+        }
+        if (own >= 0 || !wildcards) {
+            return std::max(own, 0.0);
+        }
+        return application >= 0 ? application : std::max(any, 0.0);
+    }
+}
+
+Format Encoder::negotiate(std::string_view accept, bool streamed) {
+    if (trim(accept).empty()) {
+        return Format::Json;
+    }
+    // Binary formats are sent only when asked for by name, so */* keeps getting JSON
+    Format best = Format::Json;
+    double bestQuality = quality(accept, Format::Json, true);
+    for (Format format : {Format::Cbor, Format::MsgPack}) {
+        if (streamed && format == Format::MsgPack) {
+            continue;
+        }
+        double q = quality(accept, format, false);
+        if (q > bestQuality) {
+            best = format;
+            bestQuality = q;
+        }
+    }
+    return best;
+}
+
+bool Encoder::accepts(std::string_view accept, Format format) {
+    return trim(accept).empty() || quality(accept, format, format == Format::Json) > 0;
+}
+
+Format Encoder::ofContentType(std::string_view contentType) {
+    std::string_view type = trim(contentType.substr(0, contentType.find(';')));
+    for (Format format : {Format::Cbor, Format::MsgPack}) {
+        if (isMediaType(type, format)) {
+            return format;
+        }
+    }
+    return Format::Json;
+}
+
+std::string_view Encoder::contentType(Format format) {
+    return mediaTypes(format)[0];
+}
+
+void Encoder::decode(Format format, std::string_view data, DocumentSink &out) {
+    switch (format) {
+        case Format::Cbor:
+            decodeCbor(data, out);
+            break;
+        case Format::MsgPack:
+            decodeMsgPack(data, out);
+            break;
+        default:
+            throw EncodingError("JSON is parsed, not decoded");
+    }
+}
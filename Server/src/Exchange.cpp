@@ -0,0 +1,1241 @@
+#include "Server/Exchange.h"
+
+#include <Server/Connection.h>
+
+#include <boost/date_time.hpp>
+#include <charconv>
+#include <map>
+
+#define STREAM_BATCH_ROWS 500
+#define DEFAULT_PAGE_LIMIT 100
+#define MAX_PAGE_LIMIT 1000
+
+namespace {
+    // Date and time a new operation gets when the request has none
+    struct Now {
+        std::string date;
+        std::string time;
+
+        Now() {
+            boost::posix_time::ptime timeLocal = boost::posix_time::second_clock::local_time();
+            date = to_iso_extended_string(timeLocal.date());
+            time = to_simple_string(timeLocal.time_of_day());
+        }
+    };
+
+    Operation newOperation(const JsonObject &root, const Now &now) {
+        return {0,
+                root.get<int>("id_cat"),
+                root.get<int>("id_account"),
+                root.get<Money>("amount"),
+                root.get<std::string>("date", now.date),
+                root.get<std::string>("time", now.time),
+                root.get<std::string>("comment", "")};
+    }
+
+    // Value of an optional field, missing and null ones are nullopt
+    template<class T>
+    std::optional<T> field(const JsonObject &root, std::string_view key) {
+        const JsonValue *value = root.find(key);
+        if (value == nullptr || value->type() == JsonValue::Type::Null) {
+            return std::nullopt;
+        }
+        return value->as<T>();
+    }
+
+    OperationChange operationChange(const JsonObject &root) {
+        return {field<int>(root, "id_cat"),
+                field<int>(root, "id_account"),
+                field<Money>(root, "amount"),
+                field<std::string>(root, "date"),
+                field<std::string>(root, "time"),
+                field<std::string>(root, "comment")};
+    }
+}
+
+const auto &Exchange::router() {
+    static constexpr auto router = makeRouter<Handler>({
+        {http::verb::post, "/accounts", &Exchange::addAccount},
+        {http::verb::post, "/expenses", &Exchange::addExpense},
+        {http::verb::post, "/income", &Exchange::addIncome},
+        {http::verb::post, "/expenses/batch", &Exchange::addBatch},
+        {http::verb::post, "/income/batch", &Exchange::addBatch},
+        {http::verb::post, "/categories/expenses", &Exchange::addCategory},
+        {http::verb::post, "/categories/income", &Exchange::addCategory},
+
+        {http::verb::put, "/accounts", &Exchange::modifyAccount},
+        {http::verb::put, "/expenses", &Exchange::modifyExpense},
+        {http::verb::put, "/income", &Exchange::modifyIncome},
+        {http::verb::put, "/categories/expenses", &Exchange::modifyCategory},
+        {http::verb::put, "/categories/income", &Exchange::modifyCategory},
+
+        {http::verb::get, "/accounts", &Exchange::getAccount},
+        {http::verb::get, "/expenses", &Exchange::getExpense},
+        {http::verb::get, "/income", &Exchange::getIncome},
+        {http::verb::get, "/categories/expenses", &Exchange::getByCategory},
+        {http::verb::get, "/categories/income", &Exchange::getByCategory},
+        {http::verb::get, "/summary/expenses", &Exchange::getSummary},
+        {http::verb::get, "/summary/income", &Exchange::getSummary},
+
+        {http::verb::delete_, "/accounts", &Exchange::deleteAccount},
+        {http::verb::delete_, "/expenses", &Exchange::deleteExpense},
+        {http::verb::delete_, "/income", &Exchange::deleteIncome},
+        {http::verb::delete_, "/categories/expenses", &Exchange::deleteCategory},
+        {http::verb::delete_, "/categories/income", &Exchange::deleteCategory},
+
+        {http::verb::get, "/metrics", &Exchange::getMetrics, false},
+    });
+    static_assert(router.table().size() <= METRICS_MAX_ROUTES, "Raise METRICS_MAX_ROUTES");
+    return router;
+}
+
+const Route<Exchange::Handler> *Exchange::route(http::verb verb, std::string_view path) {
+    return router().find(verb, path);
+}
+
+Exchange::Exchange(Connection &connection, DatabaseExecutor &dbExecutor, Storage &storage,
+                   ReferenceCache &referenceCache, ResponseCache &responseCache)
+    : connection(connection), dbExecutor(dbExecutor), storage(storage), referenceCache(referenceCache),
+      responseCache(responseCache),
+      req(std::piecewise_construct, std::make_tuple(Allocator(&arena)), std::make_tuple(Allocator(&arena))) {}
+
+void Exchange::reset() {
+    // The previous response is written and its handler has returned, nothing refers to the arena any more
+    response.reset();
+    req = Request(std::piecewise_construct, std::make_tuple(Allocator(&arena)), std::make_tuple(Allocator(&arena)));
+    handler = nullptr;
+    usesDatabase = false;
+    bodyFormat = Format::Json;
+    format = Format::Json;
+    encoder = std::monostate{};
+    done = false;
+    streamed = false;
+    caching = false;
+    cacheKey.clear();
+    routeIndex = METRICS_MAX_ROUTES;
+    responseStatus = http::status::ok;
+    streamedBytes = 0;
+    arena.release();
+}
+
+Exchange::Parser &Exchange::newParser(std::optional<Parser> &parser) {
+    parser.emplace(std::piecewise_construct, std::make_tuple(Allocator(&arena)), std::make_tuple(Allocator(&arena)));
+    return *parser;
+}
+
+void Exchange::accept(Request &&request) {
+    timer.start();
+    req = std::move(request);
+    auto contentType = req[http::field::content_type];
+    bodyFormat = Encoder::ofContentType({contentType.data(), contentType.size()});
+    auto accept = req[http::field::accept];
+    format = Encoder::negotiate({accept.data(), accept.size()});
+
+    // Malformed and unknown requests are answered right here, without a storage thread
+    if (!target.parse(std::string_view(req.target().data(), req.target().size()))) {
+        badRequest("Too many query parameters");
+        return;
+    }
+    const Route<Handler> *found = route(req.method(), target.path);
+    if (found == nullptr) {
+        if (req.method() == http::verb::get || req.method() == http::verb::post
+            || req.method() == http::verb::put || req.method() == http::verb::delete_) {
+            badRequest("Unknown path");
+        } else {
+            badRequest("Unknown HTTP-method");
+        }
+        return;
+    }
+    routeIndex = static_cast<std::size_t>(found - router().table().data());
+    if (format == Format::MsgPack && req.method() == http::verb::get && streamRequested()) {
+        // A stream goes out in the best of the other formats the client accepts
+        format = Encoder::negotiate({accept.data(), accept.size()}, true);
+        if (!Encoder::accepts({accept.data(), accept.size()}, format)) {
+            notAcceptable("Streamed responses are sent as JSON or CBOR");
+            return;
+        }
+    }
+    handler = found->handler;
+    usesDatabase = found->usesDatabase;
+    if (usesDatabase) {
+        timer.enter(Phase::Db); // Includes the wait for earlier requests, a storage thread and a database connection
+    }
+}
+
+void Exchange::refuse(Request &&request, http::status status, beast::string_view why) {
+    timer.start();
+    req = std::move(request);
+    req.keep_alive(false);
+    target.parse(std::string_view(req.target().data(), req.target().size())); // For the access log
+
+    Response res = makeResponse(status);
+    res.set(http::field::content_type, "text/plain");
+    res.body().assign(why.data(), why.size());
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+bool Exchange::exclusive() const {
+    return usesDatabase && (req.method() != http::verb::get || streaming());
+}
+
+void Exchange::run() {
+    // Looked up when the request's turn comes, so a hit never answers ahead of a write pipelined before it
+    if (cacheable() && answerFromCache()) {
+        connection.finished(shared_from_this());
+        return;
+    }
+    if (!usesDatabase) {
+        (this->*handler)();
+        connection.finished(shared_from_this());
+        return;
+    }
+    // Shed while the storage threads are behind: a quick 503 is better for the client than a late answer, and the
+    // queue doesn't grow further. Cache hits above still get through
+    auto queueTarget = connection.limits.queueTarget;
+    if (queueTarget.count() > 0 && dbExecutor.overloaded(queueTarget)) {
+        Metrics::get().requestShed();
+        serviceUnavailable("Server is overloaded");
+        connection.finished(shared_from_this());
+        return;
+    }
+    dbExecutor.execute([self = shared_from_this(), owner = connection.shared_from_this()] {
+        (self.get()->*(self->handler))();
+        owner->finished(self);
+    });
+}
+
+void Exchange::written(std::size_t bytes) {
+    timer.stop();
+    Metrics::get().record(routeIndex, static_cast<unsigned>(responseStatus), timer);
+    auto method = req.method_string();
+    Logger::get().access({{method.data(), method.size()}, target.path, static_cast<unsigned>(responseStatus), bytes,
+                          std::chrono::duration_cast<std::chrono::microseconds>(timer.total())});
+}
+
+void Exchange::asyncWrite(http::message_generator &&msg) {
+    // Written by the Connection after the handler returns, once the responses before it are out
+    timer.enter(Phase::Write);
+    response.emplace(std::move(msg));
+}
+
+Exchange::Response Exchange::makeResponse(http::status status) {
+    timer.enter(Phase::Serialize);
+    Response res(std::piecewise_construct, std::make_tuple(Allocator(&arena)), std::make_tuple(Allocator(&arena)));
+    res.result(status);
+    res.version(req.version());
+    responseStatus = status;
+    res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.keep_alive(req.keep_alive());
+    return res;
+}
+
+void Exchange::badRequest(beast::string_view why) {
+    Response res = makeResponse(http::status::bad_request);
+    res.set(http::field::content_type, "text/plain");
+    res.body().assign(why.data(), why.size());
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+void Exchange::notAcceptable(beast::string_view why) {
+    Response res = makeResponse(http::status::not_acceptable);
+    res.set(http::field::content_type, "text/plain");
+    res.body().assign(why.data(), why.size());
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+void Exchange::serviceUnavailable(beast::string_view why) {
+    Response res = makeResponse(http::status::service_unavailable);
+    res.set(http::field::content_type, "text/plain");
+    res.set(http::field::retry_after, std::to_string(connection.limits.retryAfter.count()));
+    res.body().assign(why.data(), why.size());
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+void Exchange::reject(const std::exception &e) {
+    if (dynamic_cast<const StorageUnavailable *>(&e) != nullptr) {
+        serviceUnavailable(e.what());
+    } else {
+        badRequest(e.what());
+    }
+}
+
+void Exchange::successResponse(http::status status) {
+    Response res = makeResponse(status);
+    res.set(http::field::content_type, "text/plain");
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+Encoder &Exchange::newEncoder() {
+    switch (format) {
+        case Format::Cbor:
+            return encoder.emplace<CborWriter>(&arena);
+        case Format::MsgPack:
+            return encoder.emplace<MsgPackWriter>(&arena);
+        default:
+            return encoder.emplace<JsonWriter>(&arena);
+    }
+}
+
+void Exchange::bodyResponse(ArenaString &&data, http::status status) {
+    if (status != http::status::ok || req.method() != http::verb::get) {
+        std::string_view type = Encoder::contentType(format);
+        Response res = makeResponse(status);
+        res.set(http::field::content_type, beast::string_view(type.data(), type.size()));
+        res.body() = std::move(data); // Moved without a copy when data comes from the arena too
+        res.prepare_payload();
+
+        asyncWrite(std::move(res));
+        return;
+    }
+
+    std::uint64_t hash = ResponseCache::hash(data);
+    ContentEncoding encoding = data.size() >= Compressor::settings().minBytes ? acceptedEncoding()
+                                                                               : ContentEncoding::Identity;
+    bool answered = notModified(ResponseCache::etag(hash, encoding));
+    if (answered && !caching) {
+        return;
+    }
+
+    // Compressed here on the storage thread, the socket's executor only writes
+    ArenaString encoded{Allocator(&arena)};
+    if (encoding != ContentEncoding::Identity) {
+        auto compressing = timer.scope(Phase::Serialize);
+        Compressor(encoding).compress(data, encoded, true);
+    }
+    if (caching) {
+        responseCache.put(cacheKey, cacheTags(), cacheGenerations,
+                          {std::string(data), hash, encoding, std::string(encoded)});
+    }
+    if (!answered) {
+        encodedResponse(encoding == ContentEncoding::Identity ? std::move(data) : std::move(encoded), hash, encoding);
+    }
+}
+
+void Exchange::encodedResponse(ArenaString &&body, std::uint64_t hash, ContentEncoding encoding) {
+    ResponseCache::ETag etag = ResponseCache::etag(hash, encoding);
+    std::string_view type = Encoder::contentType(format);
+    Response res = makeResponse(http::status::ok);
+    res.set(http::field::content_type, beast::string_view(type.data(), type.size()));
+    res.set(http::field::etag, beast::string_view(etag.data(), etag.size()));
+    res.set(http::field::vary, Compressor::settings().enabled ? "Accept, Accept-Encoding" : "Accept");
+    if (encoding != ContentEncoding::Identity) {
+        std::string_view name = Compressor::name(encoding);
+        res.set(http::field::content_encoding, beast::string_view(name.data(), name.size()));
+    }
+    res.body() = std::move(body);
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+ContentEncoding Exchange::acceptedEncoding() const {
+    auto header = req[http::field::accept_encoding];
+    return Compressor::negotiate({header.data(), header.size()});
+}
+
+bool Exchange::notModified(const ResponseCache::ETag &tag) {
+    std::string_view etag(tag.data(), tag.size());
+    auto ifNoneMatch = req[http::field::if_none_match];
+    if (ifNoneMatch.empty() || !ResponseCache::matches({ifNoneMatch.data(), ifNoneMatch.size()}, etag)) {
+        return false;
+    }
+    Response res = makeResponse(http::status::not_modified);
+    res.set(http::field::etag, beast::string_view(etag.data(), etag.size()));
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+    return true;
+}
+
+bool Exchange::cacheable() const {
+    return responseCache.enabled() && usesDatabase && req.method() == http::verb::get && !streaming();
+}
+
+bool Exchange::answerFromCache() {
+    // Parameters are ordered by key, so the same query written in another order or encoding hits the same entry;
+    // repeated keys keep their order, handlers read the first one
+    std::array<std::pair<std::string_view, std::string_view>, QUERY_CAPACITY> params;
+    std::size_t count = target.query.size();
+    for (std::size_t i = 0; i < count; ++i) {
+        params[i] = target.query.at(i);
+    }
+    std::stable_sort(params.begin(), params.begin() + static_cast<std::ptrdiff_t>(count),
+                     [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    // Each format has entries of its own
+    cacheKey.assign(1, "jcm"[static_cast<int>(format)]);
+    cacheKey.append(target.path.data(), target.path.size());
+    for (std::size_t i = 0; i < count; ++i) {
+        // Lengths go first, so nothing in a key or value can pass for a separator
+        for (std::string_view part : {params[i].first, params[i].second}) {
+            cacheKey += std::to_string(part.size());
+            cacheKey += ':';
+            cacheKey += part;
+        }
+    }
+
+    std::shared_ptr<const ResponseCache::Response> cached = responseCache.find(cacheKey, cacheGenerations);
+    if (!cached) {
+        caching = true;
+        return false;
+    }
+    auto acceptEncoding = req[http::field::accept_encoding];
+    ContentEncoding encoding = Compressor::accepts({acceptEncoding.data(), acceptEncoding.size()}, cached->encoding)
+                                   ? cached->encoding
+                                   : ContentEncoding::Identity;
+    if (notModified(ResponseCache::etag(cached->hash, encoding))) {
+        return true;
+    }
+    const std::string &body = encoding == ContentEncoding::Identity ? cached->body : cached->encoded;
+    encodedResponse(ArenaString(body.data(), body.size(), Allocator(&arena)), cached->hash, encoding);
+    return true;
+}
+
+unsigned Exchange::cacheTags() const {
+    // Operations carry ids only, so renaming an account or a category doesn't change them
+    if (target.path == "/accounts") {
+        return ResponseCache::Accounts;
+    }
+    if (target.path.starts_with("/categories/")) {
+        return ledgerTag() | categoryTag();
+    }
+    return ledgerTag();
+}
+
+unsigned Exchange::ledgerTag() const {
+    return ledger() == Ledger::Expenses ? ResponseCache::Expenses : ResponseCache::Income;
+}
+
+unsigned Exchange::categoryTag() const {
+    return ledger() == Ledger::Expenses ? ResponseCache::ExpenseCategories : ResponseCache::IncomeCategories;
+}
+
+JsonObject Exchange::parseBody() {
+    if (req.body().empty()) {
+        throw std::exception("Request's body is empty");
+    }
+    auto parsing = timer.scope(Phase::Parse);
+    if (bodyFormat == Format::Json) {
+        return JsonObject::parse(req.body());
+    }
+    return JsonObject::decode(bodyFormat, req.body());
+}
+
+void Exchange::addAccount() {
+    try {
+        JsonObject root = parseBody();
+
+        int id = storage.addAccount(root.get<std::string>("name"), root.get<Money>("amount"));
+        referenceCache.put(ReferenceCache::Table::Accounts, id, root.get<std::string>("name"));
+        responseCache.invalidate(ResponseCache::Accounts);
+        successResponse(http::status::created);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::addExpense() {
+    try {
+        JsonObject root = parseBody();
+
+        checkReferences(root, ReferenceCache::Table::ExpenseCategories);
+        storage.addOperation(Ledger::Expenses, newOperation(root, Now()));
+        responseCache.invalidate(ResponseCache::Expenses | ResponseCache::Accounts); // Balances change too
+        successResponse(http::status::created);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::addIncome() {
+    try {
+        JsonObject root = parseBody();
+
+        checkReferences(root, ReferenceCache::Table::IncomeCategories);
+        storage.addOperation(Ledger::Income, newOperation(root, Now()));
+        responseCache.invalidate(ResponseCache::Income | ResponseCache::Accounts); // Balances change too
+        successResponse(http::status::created);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::addBatch() {
+    // Body is an array of operations, or NDJSON (one operation per line) when it is JSON
+    try {
+        if (req.body().empty()) {
+            throw std::exception("Request's body is empty");
+        }
+
+        Now now;
+
+        // All rows are validated before anything is written, references against one snapshot of the cache
+        auto snapshot = referenceCache.get();
+        auto categories = categoryTable();
+        std::vector<Operation> operations;
+        auto addOperation = [&](const JsonObject &root) {
+            try {
+                Operation &operation = operations.emplace_back(newOperation(root, now));
+                if (!snapshot->accounts.contains(operation.id_account)) {
+                    throw std::exception("Account doesn't exist");
+                }
+                if (!snapshot->table(categories).contains(operation.id_cat)) {
+                    throw std::exception("Category doesn't exist");
+                }
+            } catch (std::exception &e) {
+                throw std::runtime_error("Operation " + std::to_string(operations.size() + 1) + ": " + e.what());
+            }
+        };
+
+        {
+            auto parsing = timer.scope(Phase::Parse);
+            std::string_view body = req.body();
+            if (bodyFormat != Format::Json) {
+                forEachDecodedObject(bodyFormat, body, addOperation);
+            } else if (body.find_first_not_of(" \t\r\n") != std::string_view::npos
+                && body[body.find_first_not_of(" \t\r\n")] == '[') {
+                forEachJsonObject(body, addOperation);
+            } else {
+                while (!body.empty()) {
+                    auto end = body.find('\n');
+                    auto line = body.substr(0, end);
+                    if (line.find_first_not_of(" \t\r") != std::string_view::npos) {
+                        addOperation(JsonObject::parse(line));
+                    }
+                    body = end == std::string_view::npos ? std::string_view{} : body.substr(end + 1);
+                }
+            }
+        }
+        if (operations.empty()) {
+            throw std::exception("No operations in request");
+        }
+
+        storage.addOperations(ledger(), operations);
+        responseCache.invalidate(ledgerTag() | ResponseCache::Accounts);
+
+        Encoder &writer = newEncoder();
+        writer.beginObject().key("added").value(static_cast<std::int64_t>(operations.size())).endObject();
+        bodyResponse(writer.release(), http::status::created);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::addCategory() {
+    try {
+        JsonObject root = parseBody();
+
+        int id = storage.addCategory(ledger(), root.get<std::string>("name"));
+        referenceCache.put(categoryTable(), id, root.get<std::string>("name"));
+        responseCache.invalidate(categoryTag());
+        successResponse(http::status::created);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::modifyAccount() {
+    try {
+        JsonObject root = parseBody();
+
+        if (!root.contains("id_account")) {
+            int id = storage.addAccount(root.get<std::string>("name"), root.get<Money>("amount"));
+            referenceCache.put(ReferenceCache::Table::Accounts, id, root.get<std::string>("name"));
+            responseCache.invalidate(ResponseCache::Accounts);
+            successResponse(http::status::created);
+        } else {
+            int id = root.get<int>("id_account");
+            std::optional<std::string> name = field<std::string>(root, "name");
+            if (!storage.modifyAccount(id, name, field<Money>(root, "amount"))) {
+                throw std::exception("Account doesn't exist");
+            }
+            if (name) {
+                referenceCache.put(ReferenceCache::Table::Accounts, id, *name);
+            }
+            responseCache.invalidate(ResponseCache::Accounts);
+            successResponse(http::status::ok);
+        }
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::modifyExpense() {
+    try {
+        JsonObject root = parseBody();
+
+        checkReferences(root, ReferenceCache::Table::ExpenseCategories);
+        if (!root.contains("id_expense")) {
+            storage.addOperation(Ledger::Expenses, newOperation(root, Now()));
+            responseCache.invalidate(ResponseCache::Expenses | ResponseCache::Accounts);
+            successResponse(http::status::created);
+        } else {
+            if (!storage.modifyOperation(Ledger::Expenses, root.get<int>("id_expense"), operationChange(root))) {
+                throw std::exception("Expense doesn't exist");
+            }
+            responseCache.invalidate(ResponseCache::Expenses | ResponseCache::Accounts);
+            successResponse(http::status::ok);
+        }
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::modifyIncome() {
+    try {
+        JsonObject root = parseBody();
+
+        checkReferences(root, ReferenceCache::Table::IncomeCategories);
+        if (!root.contains("id_income")) {
+            storage.addOperation(Ledger::Income, newOperation(root, Now()));
+            responseCache.invalidate(ResponseCache::Income | ResponseCache::Accounts);
+            successResponse(http::status::created);
+        } else {
+            if (!storage.modifyOperation(Ledger::Income, root.get<int>("id_income"), operationChange(root))) {
+                throw std::exception("Income doesn't exist");
+            }
+            responseCache.invalidate(ResponseCache::Income | ResponseCache::Accounts);
+            successResponse(http::status::ok);
+        }
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::modifyCategory() {
+    try {
+        JsonObject root = parseBody();
+
+        if (!root.contains("id_cat")) {
+            int id = storage.addCategory(ledger(), root.get<std::string>("name"));
+            referenceCache.put(categoryTable(), id, root.get<std::string>("name"));
+            responseCache.invalidate(categoryTag());
+            successResponse(http::status::created);
+        } else {
+            if (root.get<int>("id_cat") == OTHER_CATEGORY_ID) {
+                throw std::exception("This is a service category, it can't be edited");
+            }
+            if (!storage.renameCategory(ledger(), root.get<int>("id_cat"), root.get<std::string>("name"))) {
+                throw std::exception("Category doesn't exist");
+            }
+            referenceCache.put(categoryTable(), root.get<int>("id_cat"), root.get<std::string>("name"));
+            responseCache.invalidate(categoryTag());
+            successResponse(http::status::ok);
+        }
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getAccount() {
+    try {
+        const Query &query = target.query;
+        if (!query.contains("id")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+
+        std::optional<Account> account = storage.findAccount(id);
+        if (!account) {
+            throw std::exception("Account doesn't exist");
+        }
+
+        Encoder &writer = newEncoder();
+        writer.beginObject().key("account").beginArray().beginObject();
+        writer.key("id_account").value(account->id);
+        writer.key("name").value(account->name);
+        writer.key("amount").value(account->amount);
+        writer.endObject().endArray().endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getExpense() {
+    try {
+        std::vector<Operation> operations;
+        std::optional<Page> page;
+        Encoder &writer = newEncoder();
+        writer.beginObject();
+        const Query &query = target.query;
+        if (!query.contains("id")) {
+            if (!query.contains("begin") && !query.contains("end")) {
+                throw std::exception("Incorrect query");
+            }
+            writer.key("begin").value(query["begin"]);
+            writer.key("end").value(query["end"]);
+            Range range{.begin = std::string(query["begin"]), .end = std::string(query["end"])};
+            if (pageRequested()) {
+                page = parsePage();
+                range.page = page;
+            } else if (streamRequested()) {
+                streamRows(range, writer, "expenses", "id_expense");
+                return;
+            }
+            operations = storage.listOperations(Ledger::Expenses, range);
+        } else {
+            auto idParam = query.get<int>("id");
+            if (!idParam) {
+                throw std::exception("ID must be an integer");
+            }
+            int id = *idParam;
+
+            std::optional<Operation> found = storage.findOperation(Ledger::Expenses, id);
+            if (!found) {
+                throw std::exception("Expense doesn't exist");
+            }
+            operations.push_back(std::move(*found));
+        }
+
+        writer.key("expenses");
+        writeOperations(writer, operations, "id_expense");
+        if (page) {
+            writeNextPage(writer, operations, *page);
+        }
+        writer.endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getIncome() {
+    // возвращает инф-ю о доходе ЛИБО инф-ю о всех доходах за период
+    try {
+        std::vector<Operation> operations;
+        std::optional<Page> page;
+        Encoder &writer = newEncoder();
+        writer.beginObject();
+        const Query &query = target.query;
+        if (!query.contains("id")) {
+            if (!query.contains("begin") && !query.contains("end")) {
+                throw std::exception("Incorrect query");
+            }
+            writer.key("begin").value(query["begin"]);
+            writer.key("end").value(query["end"]);
+            Range range{.begin = std::string(query["begin"]), .end = std::string(query["end"])};
+            if (pageRequested()) {
+                page = parsePage();
+                range.page = page;
+            } else if (streamRequested()) {
+                streamRows(range, writer, "income", "id_income");
+                return;
+            }
+            operations = storage.listOperations(Ledger::Income, range);
+        } else {
+            auto idParam = query.get<int>("id");
+            if (!idParam) {
+                throw std::exception("ID must be an integer");
+            }
+            int id = *idParam;
+
+            std::optional<Operation> found = storage.findOperation(Ledger::Income, id);
+            if (!found) {
+                throw std::exception("Income doesn't exist");
+            }
+            operations.push_back(std::move(*found));
+        }
+
+        writer.key("income");
+        writeOperations(writer, operations, "id_income");
+        if (page) {
+            writeNextPage(writer, operations, *page);
+        }
+        writer.endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getByCategory() {
+    // возвращает инф-ю о тратах/доходах в категории за период
+    if (target.query.empty()) {
+        listCategories();
+        return;
+    }
+
+    try {
+        bool expenses = ledger() == Ledger::Expenses;
+        const char *key = expenses ? "expenses" : "income";
+        const char *idKey = expenses ? "id_expense" : "id_income";
+
+        Encoder &writer = newEncoder();
+        writer.beginObject();
+        const Query &query = target.query;
+        if (!query.contains("id") || !query.contains("begin") || !query.contains("end")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+        writer.key("id_cat").value(id);
+        writer.key("begin").value(query["begin"]);
+        writer.key("end").value(query["end"]);
+
+        // An empty range can't tell a missing category apart, so it is looked up in the cache
+        if (!referenceCache.contains(categoryTable(), id)) {
+            throw std::exception("Category doesn't exist");
+        }
+        Range range{.begin = std::string(query["begin"]), .end = std::string(query["end"]), .id_cat = id};
+        if (pageRequested()) {
+            Page page = parsePage();
+            range.page = page;
+            std::vector<Operation> operations = storage.listOperations(ledger(), range);
+            writer.key(key);
+            writeOperations(writer, operations, idKey);
+            writeNextPage(writer, operations, page);
+        } else if (streamRequested()) {
+            streamRows(range, writer, key, idKey);
+            return;
+        } else {
+            writer.key(key);
+            writeOperations(writer, storage.listOperations(ledger(), range), idKey);
+        }
+
+        writer.endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getSummary() {
+    try {
+        const char *key = ledger() == Ledger::Expenses ? "expenses" : "income";
+
+        const Query &query = target.query;
+        if (!query.contains("begin") || !query.contains("end")) {
+            throw std::exception("Incorrect query");
+        }
+        std::string_view by = query.contains("by") ? query["by"] : "category";
+        if (by != "category" && by != "account") {
+            throw std::exception("Summary can be by category or account");
+        }
+        std::string_view period = query.contains("period") ? query["period"] : "month";
+        if (period != "day" && period != "month" && period != "year") {
+            throw std::exception("Period must be day, month or year");
+        }
+
+        std::vector<SummaryRow> rows = storage.summary(ledger(), std::string(query["begin"]),
+                                                       std::string(query["end"]),
+                                                       by == "category" ? SummaryBy::Category : SummaryBy::Account,
+                                                       std::string(period));
+
+        Encoder &writer = newEncoder();
+        writer.beginObject();
+        writer.key("begin").value(query["begin"]);
+        writer.key("end").value(query["end"]);
+        writer.key("by").value(by);
+        writer.key("period").value(period);
+        writer.key(key).beginArray();
+        {
+            auto serializing = timer.scope(Phase::Serialize);
+            const char *keyColumn = by == "category" ? "id_cat" : "id_account";
+            for (const auto &row : rows) {
+                writer.beginObject();
+                writer.key(keyColumn).value(row.key);
+                writer.key("period").value(row.period);
+                writer.key("total").value(row.total);
+                writer.key("count").value(static_cast<std::int64_t>(row.count));
+                writer.endObject();
+            }
+        }
+        writer.endArray();
+        writer.endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::listCategories() {
+    try {
+        auto snapshot = referenceCache.get();
+        std::map<int, std::string_view> sorted;
+        for (const auto &[id, name] : snapshot->table(categoryTable())) {
+            sorted.emplace(id, name);
+        }
+
+        Encoder &writer = newEncoder();
+        writer.beginObject().key("categories").beginArray();
+        for (const auto &[id, name] : sorted) {
+            writer.beginObject().key("id_cat").value(id).key("name").value(name).endObject();
+        }
+        writer.endArray().endObject();
+        bodyResponse(writer.release());
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::deleteAccount() {
+    try {
+        const Query &query = target.query;
+
+        if (!query.contains("id")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+
+        if (!storage.deleteAccount(id)) {
+            throw std::exception("Account doesn't exist");
+        }
+        referenceCache.erase(ReferenceCache::Table::Accounts, id);
+        // The operations of the account go with it
+        responseCache.invalidate(ResponseCache::Accounts | ResponseCache::Expenses | ResponseCache::Income);
+        successResponse(http::status::ok);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::deleteExpense() {
+    try {
+        const Query &query = target.query;
+
+        if (!query.contains("id")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+
+        if (!storage.deleteOperation(Ledger::Expenses, id)) {
+            throw std::exception("Expense doesn't exist");
+        }
+        responseCache.invalidate(ResponseCache::Expenses); // The balance of the account stays as it was
+        successResponse(http::status::ok);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::deleteIncome() {
+    try {
+        const Query &query = target.query;
+
+        if (!query.contains("id")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+
+        if (!storage.deleteOperation(Ledger::Income, id)) {
+            throw std::exception("Income doesn't exist");
+        }
+        responseCache.invalidate(ResponseCache::Income); // The balance of the account stays as it was
+        successResponse(http::status::ok);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::deleteCategory() {
+    try {
+        const Query &query = target.query;
+
+        if (!query.contains("id")) {
+            throw std::exception("Incorrect query");
+        }
+        auto idParam = query.get<int>("id");
+        if (!idParam) {
+            throw std::exception("ID must be an integer");
+        }
+        int id = *idParam;
+
+        if (id == OTHER_CATEGORY_ID) {
+            throw std::exception("This is a service category, it can't be edited");
+        }
+        if (!storage.deleteCategory(ledger(), id)) {
+            throw std::exception("Category doesn't exist");
+        }
+        referenceCache.erase(categoryTable(), id);
+        responseCache.invalidate(categoryTag() | ledgerTag()); // Its operations move to the service category
+        successResponse(http::status::ok);
+    } catch (std::exception &e) {
+        reject(e);
+    }
+}
+
+void Exchange::getMetrics() {
+    std::array<RouteLabel, METRICS_MAX_ROUTES> labels;
+    auto routes = router().table();
+    for (std::size_t i = 0; i < routes.size(); ++i) {
+        auto method = http::to_string(routes[i].verb);
+        labels[i] = {{method.data(), method.size()}, routes[i].path};
+    }
+
+    ArenaString out{Allocator(&arena)};
+    Metrics::get().write(out, std::span(labels.data(), routes.size()));
+    storage.writeMetrics(out);
+    responseCache.writeMetrics(out);
+    Metrics::gauge(out, "finance_db_queue_wait_seconds_average", "Average wait for a storage thread.",
+                   std::chrono::duration<double>(dbExecutor.averageQueueWait()).count());
+
+    Response res = makeResponse(http::status::ok);
+    res.set(http::field::content_type, "text/plain; version=0.0.4");
+    res.body() = std::move(out);
+    res.prepare_payload();
+
+    asyncWrite(std::move(res));
+}
+
+Ledger Exchange::ledger() const {
+    return target.path.find("expenses") != std::string_view::npos ? Ledger::Expenses : Ledger::Income;
+}
+
+ReferenceCache::Table Exchange::categoryTable() const {
+    return ledger() == Ledger::Expenses ? ReferenceCache::Table::ExpenseCategories
+                                        : ReferenceCache::Table::IncomeCategories;
+}
+
+void Exchange::checkReferences(const JsonObject &root, ReferenceCache::Table categories) const {
+    auto snapshot = referenceCache.get();
+    if (root.contains("id_account") && !snapshot->accounts.contains(root.get<int>("id_account"))) {
+        throw std::exception("Account doesn't exist");
+    }
+    if (root.contains("id_cat") && !snapshot->table(categories).contains(root.get<int>("id_cat"))) {
+        throw std::exception("Category doesn't exist");
+    }
+}
+
+bool Exchange::pageRequested() const {
+    return target.query.contains("limit") || target.query.contains("cursor");
+}
+
+Page Exchange::parsePage() const {
+    const Query &query = target.query;
+    // The cursor is "date_time_id" of the last row of the previous page, the first page starts right at begin
+    Page page{std::string(query["begin"]), "00:00:00", 0, DEFAULT_PAGE_LIMIT};
+
+    if (query.contains("limit")) {
+        auto limit = query.get<int>("limit");
+        if (!limit || *limit < 1 || *limit > MAX_PAGE_LIMIT) {
+            throw std::exception("Limit must be an integer between 1 and " BOOST_STRINGIZE(MAX_PAGE_LIMIT));
+        }
+        page.limit = *limit;
+    }
+
+    if (query.contains("cursor")) {
+        std::string_view cursor = query["cursor"];
+        auto first = cursor.find('_');
+        auto second = cursor.find('_', first + 1);
+        if (first == std::string_view::npos || second == std::string_view::npos) {
+            throw std::exception("Incorrect cursor");
+        }
+        page.date = cursor.substr(0, first);
+        page.time = cursor.substr(first + 1, second - first - 1);
+        auto [end, error] = std::from_chars(cursor.data() + second + 1, cursor.data() + cursor.size(), page.id);
+        if (error != std::errc() || end != cursor.data() + cursor.size()) {
+            throw std::exception("Incorrect cursor");
+        }
+    }
+    return page;
+}
+
+void Exchange::writeNextPage(Encoder &writer, const std::vector<Operation> &operations, const Page &page) {
+    auto serializing = timer.scope(Phase::Serialize);
+    // A full page means there may be more rows, the client passes "next" back as the cursor
+    writer.key("next");
+    if (operations.size() < static_cast<std::size_t>(page.limit)) {
+        writer.null();
+        return;
+    }
+    const Operation &last = operations.back();
+    writer.value(last.date + "_" + last.time + "_" + std::to_string(last.id));
+}
+
+bool Exchange::streamRequested() const {
+    // Chunked transfer encoding needs HTTP/1.1
+    return req.version() >= 11 && target.query.contains("stream") && target.query["stream"] != "0"
+           && target.query["stream"] != "false";
+}
+
+void Exchange::streamRows(const Range &range, Encoder &writer, const char *key, const char *idKey) {
+    // Until the first batch arrives errors are answered with 400 as usual, once the header is out the connection
+    // can only be dropped
+    std::shared_ptr<ChunkedResponse> chunked;
+    bool gone = false;
+    bool keep_alive = req.keep_alive();
+    columnsRequested(); // An unknown shape is rejected while a 400 can still be sent
+    // Streams are large by nature, so they are compressed whatever their size; each batch is flushed on its own
+    ContentEncoding encoding = acceptedEncoding();
+    std::optional<Compressor> compressor;
+    ArenaString encoded{Allocator(&arena)};
+
+    try {
+        storage.scanOperations(ledger(), range, STREAM_BATCH_ROWS, [&](std::span<const Operation> rows, bool last) {
+            if (!chunked) {
+                chunked = std::make_shared<ChunkedResponse>();
+                chunked->res.version(req.version());
+                chunked->res.result(http::status::ok);
+                chunked->res.set(http::field::server, BOOST_BEAST_VERSION_STRING);
+                std::string_view type = Encoder::contentType(format);
+                chunked->res.set(http::field::content_type, beast::string_view(type.data(), type.size()));
+                chunked->res.set(http::field::vary, "Accept");
+                chunked->res.keep_alive(keep_alive);
+                chunked->res.chunked(true);
+                if (encoding != ContentEncoding::Identity) {
+                    std::string_view name = Compressor::name(encoding);
+                    chunked->res.set(http::field::content_encoding, beast::string_view(name.data(), name.size()));
+                    chunked->res.set(http::field::vary, "Accept, Accept-Encoding");
+                    compressor.emplace(encoding);
+                }
+                responseStatus = http::status::ok;
+                streamedBytes = 0;
+                writer.key(key);
+                beginRows(writer, idKey);
+            }
+            writeOperationRows(writer, rows, idKey);
+            if (last) {
+                endRows(writer);
+                writer.endObject();
+            }
+            std::string_view chunk = writer.str();
+            if (compressor) {
+                auto compressing = timer.scope(Phase::Serialize);
+                encoded.clear();
+                compressor->compress(chunk, encoded, last);
+                chunk = encoded;
+            }
+            if (writeChunk(*chunked, chunk)) {
+                gone = true; // Client is gone, the scan stops here
+                return false;
+            }
+            writer.consume(); // The chunk is written, its buffer is reused for the next batch
+            return true;
+        });
+    } catch (std::exception &e) {
+        if (!chunked) {
+            throw;
+        }
+        Logger::error("Fail on streaming: ", e.what());
+        return; // Neither a response nor a finished stream, the Connection drops the socket
+    }
+
+    streamed = !gone && !writeChunk(*chunked, {}, true);
+}
+
+beast::error_code Exchange::writeChunk(ChunkedResponse &chunked, std::string_view data, bool last) {
+    if (data.empty() && !last) {
+        return {};
+    }
+
+    // The storage thread waits for every chunk, so only one batch of rows is held in memory at a time
+    auto writing = timer.scope(Phase::Write);
+    std::promise<beast::error_code> written;
+    auto result = written.get_future();
+    net::post(connection.stream.get_executor(), [this, &chunked, &data, &written, last] {
+        chunked.res.body().data = last ? nullptr : const_cast<char *>(data.data());
+        chunked.res.body().size = last ? 0 : data.size();
+        chunked.res.body().more = !last;
+        auto onWrite = [this, &written](beast::error_code error, std::size_t bytes) {
+            streamedBytes += bytes;
+            if (error == http::error::need_buffer) {
+                error = {};
+            }
+            written.set_value(error);
+        };
+        connection.stream.expires_after(connection.limits.writeTimeout);
+        http::async_write(connection.stream, chunked.serializer, onWrite);
+    });
+    return result.get();
+}
+
+void Exchange::writeOperations(Encoder &writer, std::span<const Operation> operations, const char *idKey) {
+    beginRows(writer, idKey);
+    writeOperationRows(writer, operations, idKey);
+    endRows(writer);
+}
+
+bool Exchange::columnsRequested() const {
+    auto shape = target.query.find("shape");
+    if (!shape || *shape == "rows") {
+        return false;
+    }
+    if (*shape != "columns") {
+        throw std::exception("Shape must be rows or columns");
+    }
+    return true;
+}
+
+void Exchange::beginRows(Encoder &writer, const char *idKey) {
+    if (!columnsRequested()) {
+        writer.beginArray();
+        return;
+    }
+    writer.beginObject().key("columns").beginArray();
+    for (const char *column : {idKey, "id_cat", "id_account", "amount", "date", "time", "comment"}) {
+        writer.value(column);
+    }
+    writer.endArray().key("rows").beginArray();
+}
+
+void Exchange::endRows(Encoder &writer) {
+    writer.endArray();
+    if (columnsRequested()) {
+        writer.endObject();
+    }
+}
+
+void Exchange::writeOperationRows(Encoder &writer, std::span<const Operation> operations, const char *idKey) {
+    // Same fields and order as the columns of the expenses and income tables
+    auto serializing = timer.scope(Phase::Serialize);
+    if (columnsRequested()) {
+        for (const auto &operation : operations) {
+            writer.beginArray();
+            writer.value(operation.id).value(operation.id_cat).value(operation.id_account).value(operation.amount);
+            writer.date(operation.date).value(operation.time);
+            if (operation.comment) {
+                writer.value(*operation.comment);
+            } else {
+                writer.null();
+            }
+            writer.endArray();
+        }
+        return;
+    }
+    for (const auto &operation : operations) {
+        writer.beginObject();
+        writer.key(idKey).value(operation.id);
+        writer.key("id_cat").value(operation.id_cat);
+        writer.key("id_account").value(operation.id_account);
+        writer.key("amount").value(operation.amount);
+        writer.key("date").date(operation.date);
+        writer.key("time").value(operation.time);
+        writer.key("comment");
+        if (operation.comment) {
+            writer.value(*operation.comment);
+        } else {
+            writer.null();
+        }
+        writer.endObject();
+    }
+}
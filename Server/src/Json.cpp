@@ -0,0 +1,643 @@
+#include "Server/Json.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace {
+    class Parser {
+    private:
+        std::string_view text;
+        std::size_t pos = 0;
+
+    public:
+        explicit Parser(std::string_view text) : text(text) {}
+
+        [[noreturn]] void fail(const char *what) const {
+            throw JsonError(std::string(what) + " at offset " + std::to_string(pos));
+        }
+
+        void skipSpaces() {
+            while (pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r')) {
+                pos++;
+            }
+        }
+
+        bool atEnd() {
+            skipSpaces();
+            return pos == text.size();
+        }
+
+        bool consume(char c) {
+            skipSpaces();
+            if (pos < text.size() && text[pos] == c) {
+                pos++;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char c) {
+            if (!consume(c)) {
+                fail((std::string("Expected '") + c + "'").c_str());
+            }
+        }
+
+        // Returns the contents between the quotes. Escapes are checked here but decoded by JsonValue::str(), so
+        // a document is refused whichever of its fields are read
+        std::string_view string(bool &escaped) {
+            expect('"');
+            std::size_t start = pos;
+            escaped = false;
+            while (pos < text.size() && text[pos] != '"') {
+                if (text[pos] == '\\') {
+                    escaped = true;
+                    escape();
+                } else if (static_cast<unsigned char>(text[pos]) < 0x20) {
+                    fail("Control character in string");
+                } else {
+                    pos++;
+                }
+            }
+            if (pos >= text.size()) {
+                fail("Unterminated string");
+            }
+            return text.substr(start, pos++ - start);
+        }
+
+        // Skips a backslash and what it escapes: one of "\/bfnrt, or u and four hex digits
+        void escape() {
+            pos++;
+            if (pos < text.size() && std::string_view("\"\\/bfnrt").find(text[pos]) != std::string_view::npos) {
+                pos++;
+                return;
+            }
+            if (pos < text.size() && text[pos] == 'u' && text.size() - pos > 4
+                && std::all_of(text.begin() + pos + 1, text.begin() + pos + 5,
+                               [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; })) {
+                pos += 5;
+                return;
+            }
+            fail("Incorrect escape in string");
+        }
+
+        // depth is the nesting of the value, the top-level object being 0
+        JsonValue value(int depth) {
+            skipSpaces();
+            if (pos >= text.size()) {
+                fail("Unexpected end of JSON");
+            }
+            std::size_t start = pos;
+            char c = text[pos];
+            if (c == '"') {
+                bool escaped;
+                auto contents = string(escaped);
+                return {JsonValue::Type::String, contents, escaped};
+            }
+            if (c == '{' || c == '[') {
+                skipContainer(depth);
+                return {c == '{' ? JsonValue::Type::Object : JsonValue::Type::Array, text.substr(start, pos - start)};
+            }
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                number();
+                return {JsonValue::Type::Number, text.substr(start, pos - start)};
+            }
+            for (auto [word, type] : {std::pair{std::string_view("true"), JsonValue::Type::Bool},
+                                      std::pair{std::string_view("false"), JsonValue::Type::Bool},
+                                      std::pair{std::string_view("null"), JsonValue::Type::Null}}) {
+                if (text.substr(pos, word.size()) == word) {
+                    pos += word.size();
+                    return {type, word};
+                }
+            }
+            fail("Unexpected character");
+        }
+
+        // Skips the digits at pos, false when there are none
+        bool digits() {
+            std::size_t start = pos;
+            while (pos < text.size() && text[pos] >= '0' && text[pos] <= '9') {
+                pos++;
+            }
+            return pos != start;
+        }
+
+        // -?(0|[1-9][0-9]*)(.[0-9]+)?([eE][+-]?[0-9]+)?, what follows is left to the caller
+        void number() {
+            if (text[pos] == '-') {
+                pos++;
+            }
+            if (pos < text.size() && text[pos] == '0') {
+                pos++;
+            } else if (!digits()) {
+                fail("Incorrect number");
+            }
+            if (pos < text.size() && text[pos] == '.') {
+                pos++;
+                if (!digits()) {
+                    fail("Incorrect number");
+                }
+            }
+            if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+                pos++;
+                if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) {
+                    pos++;
+                }
+                if (!digits()) {
+                    fail("Incorrect number");
+                }
+            }
+        }
+
+        void skipContainer(int depth) {
+            // Nesting is bounded like in the CBOR and MessagePack decoders, so a body of brackets can't exhaust
+            // the stack
+            if (depth > ENCODER_MAX_DEPTH) {
+                fail("JSON is nested too deep");
+            }
+            char open = text[pos];
+            char close = open == '{' ? '}' : ']';
+            pos++;
+            if (consume(close)) {
+                return;
+            }
+            do {
+                if (open == '{') {
+                    bool escaped;
+                    string(escaped);
+                    expect(':');
+                }
+                value(depth + 1);
+            } while (consume(','));
+            expect(close);
+        }
+
+        void object(std::vector<std::pair<std::string_view, JsonValue>> &fields, int depth = 0) {
+            expect('{');
+            if (consume('}')) {
+                return;
+            }
+            do {
+                bool escaped;
+                auto key = string(escaped);
+                expect(':');
+                fields.emplace_back(key, value(depth + 1));
+            } while (consume(','));
+            expect('}');
+        }
+    };
+
+    void appendUtf8(std::string &out, unsigned codepoint) {
+        if (codepoint < 0x80) {
+            out += static_cast<char>(codepoint);
+        } else if (codepoint < 0x800) {
+            out += static_cast<char>(0xC0 | (codepoint >> 6));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else if (codepoint < 0x10000) {
+            out += static_cast<char>(0xE0 | (codepoint >> 12));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (codepoint >> 18));
+            out += static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (codepoint & 0x3F));
+        }
+    }
+
+    unsigned parseHex4(std::string_view text, std::size_t pos) {
+        unsigned codepoint = 0;
+        if (pos + 4 > text.size() || std::from_chars(text.data() + pos, text.data() + pos + 4, codepoint, 16).ptr
+                                     != text.data() + pos + 4) {
+            throw JsonError("Incorrect \\u escape");
+        }
+        return codepoint;
+    }
+}
+
+// Fields of a decoded map, or of every map in a decoded array. Values nested deeper keep only their type.
+class JsonObject::Builder final : public DocumentSink {
+private:
+    JsonObject &object;
+    std::string_view data; // Strings inside the decoded data are viewed, others are copied into object
+    const std::function<void(const JsonObject &)> *each; // Null for a single map
+    int depth = 0;
+    std::string_view name; // Key of the next field
+
+    int level() const { return each == nullptr ? 1 : 2; } // Depth of the fields that are collected
+
+    [[noreturn]] void fail() const {
+        throw EncodingError(each == nullptr ? "Expected a map" : "Expected an array of maps");
+    }
+
+    std::string_view own(std::string_view text) {
+        if (text.empty() || (std::greater_equal<>()(text.data(), data.data())
+                             && std::less_equal<>()(text.data() + text.size(), data.data() + data.size()))) {
+            return text;
+        }
+        return object.owned.emplace_back(text);
+    }
+
+    void field(const JsonValue &value) {
+        if (depth == level()) {
+            object.fields.emplace_back(name, value);
+        } else if (depth < level()) {
+            fail();
+        }
+    }
+
+    void open(JsonValue::Type type) {
+        if (depth == level()) {
+            field({type, {}});
+        } else if (depth < level()) {
+            // The map of the fields, or the array around the maps
+            if ((type == JsonValue::Type::Object) != (depth == level() - 1)) {
+                fail();
+            }
+            if (type == JsonValue::Type::Object) {
+                object.fields.clear();
+                object.owned.clear();
+            }
+        }
+        depth++;
+    }
+
+    void close() {
+        depth--;
+        if (each != nullptr && depth == level() - 1) {
+            (*each)(object);
+        }
+    }
+
+public:
+    Builder(JsonObject &object, std::string_view data, const std::function<void(const JsonObject &)> *each)
+        : object(object), data(data), each(each) {}
+
+    void beginObject() override { open(JsonValue::Type::Object); }
+    void endObject() override { close(); }
+    void beginArray() override { open(JsonValue::Type::Array); }
+    void endArray() override { close(); }
+
+    void key(std::string_view text) override {
+        if (depth == level()) {
+            name = own(text);
+        }
+    }
+
+    void value(std::string_view text) override {
+        if (depth == level()) {
+            text = own(text);
+        }
+        field({JsonValue::Type::String, text});
+    }
+
+    void value(std::int64_t number) override { field(JsonValue(number)); }
+    void value(double number) override { field(JsonValue(number)); }
+    void value(Money amount) override { field(JsonValue(amount)); }
+    void value(bool flag) override { field({JsonValue::Type::Bool, flag ? "true" : "false"}); }
+    void null() override { field({JsonValue::Type::Null, "null"}); }
+};
+
+template<class T>
+T JsonValue::number() const {
+    if (decoded == Decoded::None) {
+        if (type_ != Type::Number && type_ != Type::String) {
+            throw JsonError("Value is not a number");
+        }
+        T result{};
+        auto [end, error] = [&] {
+            if constexpr (std::is_same_v<T, Money>) {
+                return fromChars(raw.data(), raw.data() + raw.size(), result);
+            } else {
+                return std::from_chars(raw.data(), raw.data() + raw.size(), result);
+            }
+        }();
+        if (error != std::errc() || end != raw.data() + raw.size()) {
+            throw JsonError("Incorrect number \"" + std::string(raw) + "\"");
+        }
+        return result;
+    }
+
+    // Decoded numbers are converted without text, by the rules of JSON ones: integers must be whole and in range,
+    // amounts have at most two fraction digits
+    if constexpr (std::is_same_v<T, double>) {
+        if (decoded == Decoded::Real) {
+            return real;
+        }
+        return decoded == Decoded::Integer ? static_cast<double>(integer) : static_cast<double>(integer) / MONEY_SCALE;
+    } else if constexpr (std::is_same_v<T, Money>) {
+        if (decoded == Decoded::Amount) {
+            return Money::fromMinor(integer);
+        }
+        if (decoded == Decoded::Integer) {
+            if (integer <= std::numeric_limits<std::int64_t>::max() / MONEY_SCALE
+                && integer >= std::numeric_limits<std::int64_t>::min() / MONEY_SCALE) {
+                return Money::fromUnits(integer);
+            }
+        } else {
+            // A float is read from its shortest form, so 12.34 is exact and 12.345 is refused like in JSON
+            std::array<char, 32> buffer{};
+            char *end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), real).ptr;
+            Money amount;
+            auto [last, error] = fromChars(buffer.data(), end, amount);
+            if (error == std::errc() && last == end) {
+                return amount;
+            }
+        }
+    } else {
+        std::int64_t whole = integer;
+        bool exact = decoded == Decoded::Integer;
+        if (decoded == Decoded::Amount) {
+            exact = integer % MONEY_SCALE == 0;
+            whole = integer / MONEY_SCALE;
+        } else if (decoded == Decoded::Real) {
+            exact = std::trunc(real) == real && real >= -0x1p63 && real < 0x1p63;
+            whole = exact ? static_cast<std::int64_t>(real) : 0;
+        }
+        if (exact && std::in_range<T>(whole)) {
+            return static_cast<T>(whole);
+        }
+    }
+    throw JsonError("Incorrect number \"" + str() + "\"");
+}
+
+std::string JsonValue::str() const {
+    if (type_ == Type::Null) {
+        return {};
+    }
+    if (decoded != Decoded::None) {
+        std::array<char, 32> buffer{};
+        char *first = buffer.data();
+        char *last = buffer.data() + buffer.size();
+        char *end = decoded == Decoded::Integer ? std::to_chars(first, last, integer).ptr
+                    : decoded == Decoded::Real  ? std::to_chars(first, last, real).ptr
+                                                : toChars(first, last, Money::fromMinor(integer)).ptr;
+        return std::string(first, end);
+    }
+    if (!escaped) {
+        return std::string(raw);
+    }
+
+    std::string out;
+    out.reserve(raw.size());
+    for (std::size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] != '\\') {
+            out += raw[i];
+            continue;
+        }
+        switch (raw[++i]) {
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u': {
+                unsigned codepoint = parseHex4(raw, i + 1);
+                i += 4;
+                // Code points above the BMP are a high and a low surrogate, neither is valid alone
+                if (codepoint >= 0xD800 && codepoint < 0xDC00) {
+                    unsigned low = raw.substr(i + 1, 2) == "\\u" ? parseHex4(raw, i + 3) : 0;
+                    if (low < 0xDC00 || low > 0xDFFF) {
+                        throw JsonError("Unpaired surrogate in \\u escape");
+                    }
+                    codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                    i += 6;
+                } else if (codepoint >= 0xDC00 && codepoint <= 0xDFFF) {
+                    throw JsonError("Unpaired surrogate in \\u escape");
+                }
+                appendUtf8(out, codepoint);
+                break;
+            }
+            default: out += raw[i]; break;
+        }
+    }
+    return out;
+}
+
+template<>
+int JsonValue::as<int>() const {
+    return number<int>();
+}
+
+template<>
+long JsonValue::as<long>() const {
+    return number<long>();
+}
+
+template<>
+long long JsonValue::as<long long>() const {
+    return number<long long>();
+}
+
+template<>
+double JsonValue::as<double>() const {
+    return number<double>();
+}
+
+template<>
+Money JsonValue::as<Money>() const {
+    return number<Money>();
+}
+
+template<>
+bool JsonValue::as<bool>() const {
+    if (raw == "true") {
+        return true;
+    }
+    if (raw == "false") {
+        return false;
+    }
+    throw JsonError("Value is not a boolean");
+}
+
+template<>
+std::string JsonValue::as<std::string>() const {
+    return str();
+}
+
+JsonObject JsonObject::parse(std::string_view text) {
+    Parser parser(text);
+    JsonObject result;
+    parser.object(result.fields);
+    if (!parser.atEnd()) {
+        parser.fail("Unexpected data after JSON object");
+    }
+    return result;
+}
+
+const JsonValue *JsonObject::find(std::string_view key) const {
+    for (const auto &[name, value] : fields) {
+        if (name == key) {
+            return &value;
+        }
+    }
+    return nullptr;
+}
+
+JsonObject JsonObject::decode(Format format, std::string_view data) {
+    JsonObject result;
+    Builder builder(result, data, nullptr);
+    Encoder::decode(format, data, builder);
+    return result;
+}
+
+bool JsonObject::contains(std::string_view key) const {
+    return find(key) != nullptr;
+}
+
+void forEachJsonObject(std::string_view text, const std::function<void(const JsonObject &)> &f) {
+    Parser parser(text);
+    parser.expect('[');
+    if (!parser.consume(']')) {
+        JsonObject object;
+        do {
+            object.fields.clear();
+            parser.object(object.fields, 1);
+            f(object);
+        } while (parser.consume(','));
+        parser.expect(']');
+    }
+    if (!parser.atEnd()) {
+        parser.fail("Unexpected data after JSON array");
+    }
+}
+
+void forEachDecodedObject(Format format, std::string_view data, const std::function<void(const JsonObject &)> &f) {
+    JsonObject object;
+    JsonObject::Builder builder(object, data, &f);
+    Encoder::decode(format, data, builder);
+}
+
+void JsonWriter::separate() {
+    if (comma) {
+        out += ',';
+    }
+    comma = true;
+}
+
+JsonWriter &JsonWriter::beginObject() {
+    separate();
+    out += '{';
+    comma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::endObject() {
+    out += '}';
+    comma = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::beginArray() {
+    separate();
+    out += '[';
+    comma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::endArray() {
+    out += ']';
+    comma = true;
+    return *this;
+}
+
+JsonWriter &JsonWriter::key(std::string_view name) {
+    value(name);
+    out += ':';
+    comma = false;
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(std::string_view text) {
+    separate();
+    out += '"';
+    std::size_t plain = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        auto c = static_cast<unsigned char>(text[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(text, plain, i - plain);
+        plain = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default: {
+                std::array<char, 7> escaped{};
+                std::snprintf(escaped.data(), escaped.size(), "\\u%04x", c);
+                out += escaped.data();
+            }
+        }
+    }
+    out.append(text, plain, text.size() - plain);
+    out += '"';
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(std::int64_t number) {
+    separate();
+    std::array<char, 24> buffer{};
+    auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number).ptr;
+    out.append(buffer.data(), end);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(double number) {
+    if (!std::isfinite(number)) {
+        return null(); // JSON has no NaN or infinity
+    }
+    separate();
+    std::array<char, 32> buffer{};
+    auto end = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number).ptr;
+    out.append(buffer.data(), end);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(Money amount) {
+    separate();
+    std::array<char, MONEY_MAX_CHARS> buffer{};
+    auto end = toChars(buffer.data(), buffer.data() + buffer.size(), amount).ptr;
+    out.append(buffer.data(), end);
+    return *this;
+}
+
+JsonWriter &JsonWriter::value(bool flag) {
+    separate();
+    out += flag ? "true" : "false";
+    return *this;
+}
+
+JsonWriter &JsonWriter::null() {
+    separate();
+    out += "null";
+    return *this;
+}
+
+JsonWriter &JsonWriter::number(std::string_view text) {
+    separate();
+    out += text;
+    return *this;
+}
+
+ArenaString JsonWriter::release() {
+    comma = false;
+    return std::move(out);
+}
+
+void JsonWriter::consume() {
+    out.clear();
+}
+
+void JsonWriter::clear() {
+    out.clear();
+    comma = false;
+}
@@ -0,0 +1,193 @@
+#include "Server/Logger.h"
+
+#include <Server/Json.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+namespace {
+    const char *levelName(LogLevel level) {
+        switch (level) {
+            case LogLevel::Debug:
+                return "debug";
+            case LogLevel::Info:
+                return "info";
+            case LogLevel::Warning:
+                return "warning";
+            default:
+                return "error";
+        }
+    }
+
+    void writeTime(JsonWriter &writer, std::chrono::system_clock::time_point time) {
+        // 2023-01-15T16:31:00.123Z
+        std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+        auto millis = std::chrono::duration_cast<std::chrono::milliseconds>(time.time_since_epoch()).count() % 1000;
+        std::tm tm{};
+#ifdef _WIN32
+        gmtime_s(&tm, &seconds);
+#else
+        gmtime_r(&seconds, &tm);
+#endif
+        char text[32];
+        std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ", tm.tm_year + 1900, tm.tm_mon + 1,
+                      tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, static_cast<int>(millis));
+        writer.key("ts").value(text);
+    }
+
+    void writeLine(JsonWriter &writer) {
+        std::string_view line = writer.str();
+        std::fwrite(line.data(), 1, line.size(), stdout);
+        std::fputc('\n', stdout);
+        writer.clear();
+    }
+
+    thread_local unsigned accessCounter = 0;
+}
+
+Logger::Logger() : slots(new Slot[LOG_QUEUE_CAPACITY]) {
+    for (std::uint64_t i = 0; i < LOG_QUEUE_CAPACITY; ++i) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    writer = std::thread([this] { run(); });
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+Logger &Logger::get() {
+    static Logger logger;
+    return logger;
+}
+
+LogLevel Logger::parseLevel(std::string_view name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warning") return LogLevel::Warning;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    throw std::invalid_argument("Unknown log level: " + std::string(name));
+}
+
+void Logger::configure(LogLevel level, unsigned sample) {
+    minLevel.store(level, std::memory_order_relaxed);
+    accessSample.store(std::max(sample, 1u), std::memory_order_relaxed);
+}
+
+Logger::Record *Logger::acquire(std::uint64_t &position) {
+    // Bounded MPSC queue: a slot is free for position when its sequence equals position
+    position = head.load(std::memory_order_relaxed);
+    while (true) {
+        Slot &slot = slots[position & (LOG_QUEUE_CAPACITY - 1)];
+        std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+        auto difference = static_cast<std::int64_t>(sequence - position);
+        if (difference == 0) {
+            if (head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                return &slot.record;
+            }
+        } else if (difference < 0) {
+            droppedRecords.fetch_add(1, std::memory_order_relaxed); // Full, the writer is behind
+            return nullptr;
+        } else {
+            position = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void Logger::publish(std::uint64_t position) {
+    slots[position & (LOG_QUEUE_CAPACITY - 1)].sequence.store(position + 1, std::memory_order_release);
+}
+
+void Logger::access(const AccessRecord &access) {
+    if (!enabled(LogLevel::Info)) {
+        return;
+    }
+    if (access.status < 400 && ++accessCounter % accessSample.load(std::memory_order_relaxed) != 0) {
+        return;
+    }
+
+    std::uint64_t position;
+    Record *record = acquire(position);
+    if (record == nullptr) {
+        return;
+    }
+    record->time = std::chrono::system_clock::now();
+    record->level = LogLevel::Info;
+    record->access = true;
+    record->textSize = static_cast<std::uint16_t>(std::min(access.method.size(), record->text.size()));
+    std::copy_n(access.method.data(), record->textSize, record->text.data());
+    record->pathSize = static_cast<std::uint16_t>(std::min(access.path.size(), record->path.size()));
+    std::copy_n(access.path.data(), record->pathSize, record->path.data());
+    record->status = access.status;
+    record->bytes = access.bytes;
+    record->latencyUs = access.latency.count();
+    publish(position);
+}
+
+bool Logger::drain(JsonWriter &writer) {
+    std::uint64_t reportedDrops = droppedRecords.exchange(0, std::memory_order_relaxed);
+    if (reportedDrops != 0) {
+        writer.beginObject();
+        writeTime(writer, std::chrono::system_clock::now());
+        writer.key("level").value("warning");
+        writer.key("msg").value("Log records dropped");
+        writer.key("dropped").value(static_cast<std::int64_t>(reportedDrops));
+        writer.endObject();
+        writeLine(writer);
+    }
+
+    bool any = false;
+    while (true) {
+        Slot &slot = slots[tail & (LOG_QUEUE_CAPACITY - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != tail + 1) {
+            break;
+        }
+        const Record &record = slot.record;
+        writer.beginObject();
+        writeTime(writer, record.time);
+        writer.key("level").value(levelName(record.level));
+        if (record.access) {
+            writer.key("type").value("access");
+            writer.key("method").value(std::string_view(record.text.data(), record.textSize));
+            writer.key("path").value(std::string_view(record.path.data(), record.pathSize));
+            writer.key("status").value(static_cast<std::int64_t>(record.status));
+            writer.key("bytes").value(static_cast<std::int64_t>(record.bytes));
+            writer.key("latency_us").value(record.latencyUs);
+        } else {
+            writer.key("msg").value(std::string_view(record.text.data(), record.textSize));
+        }
+        writer.endObject();
+        slot.sequence.store(tail + LOG_QUEUE_CAPACITY, std::memory_order_release);
+        ++tail;
+
+        writeLine(writer);
+        any = true;
+    }
+    if (any || reportedDrops != 0) {
+        std::fflush(stdout); // One flush per batch instead of one per line
+    }
+    return any;
+}
+
+void Logger::run() {
+    JsonWriter writer(LOG_TEXT_SIZE * 2); // Reused for every line
+    while (!stopping.load(std::memory_order_acquire)) {
+        if (!drain(writer)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+    drain(writer);
+}
+
+void Logger::stop() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
@@ -0,0 +1,324 @@
+#include "Server/MemoryStorage.h"
+
+#include <Server/Calendar.h>
+#include <Server/Metrics.h>
+
+#include <algorithm>
+#include <climits>
+#include <mutex>
+
+MemoryStorage::MemoryStorage(bool sample) {
+    for (auto &ledgerData : ledgers) {
+        ledgerData.categories.emplace(OTHER_CATEGORY_ID, "Other");
+        ledgerData.nextCategory = OTHER_CATEGORY_ID + 1;
+    }
+    if (sample) {
+        loadSample();
+    }
+}
+
+void MemoryStorage::loadSample() {
+    for (const char *name : {"Sberbank", "Tinkoff", "VTB"}) {
+        accounts.emplace(nextAccount, Account{nextAccount, name, Money()});
+        nextAccount++;
+    }
+    for (const char *name : {"Products", "Transport", "Cafe", "Gift", "Subscription", "Health"}) {
+        data(Ledger::Expenses).categories.emplace(data(Ledger::Expenses).nextCategory++, name);
+    }
+    for (const char *name : {"Salary", "Cashback", "Parents", "Gift", "interest on the deposit", "Dividends"}) {
+        data(Ledger::Income).categories.emplace(data(Ledger::Income).nextCategory++, name);
+    }
+
+    // Inserted as is, the balances stay at 0 like in the SQL script
+    insert(Ledger::Expenses, {0, 1, 1, Money::fromUnits(5324), "2022-12-31", "12:40", ""});
+    insert(Ledger::Expenses, {0, 2, 2, Money::fromUnits(98), "2023-01-29", "13:31", ""});
+    insert(Ledger::Expenses, {0, 3, 3, Money::fromUnits(1238), "2023-01-12", "16:01", ""});
+    insert(Ledger::Expenses, {0, 4, 1, Money::fromUnits(7654), "2023-02-21", "22:59", ""});
+    insert(Ledger::Expenses, {0, 5, 2, Money::fromUnits(365), "2023-02-25", "09:32", ""});
+    insert(Ledger::Expenses, {0, 6, 3, Money::fromUnits(6570), "2023-03-07", "20:57", ""});
+
+    insert(Ledger::Income, {0, 1, 1, Money::fromUnits(10000), "2022-12-23", "11:22", ""});
+    insert(Ledger::Income, {0, 2, 2, Money::fromUnits(20000), "2023-01-15", "16:31", ""});
+    insert(Ledger::Income, {0, 3, 3, Money::fromUnits(30000), "2023-01-01", "04:16", ""});
+    insert(Ledger::Income, {0, 4, 1, Money::fromUnits(40000), "2023-02-09", "15:38", ""});
+    insert(Ledger::Income, {0, 5, 2, Money::fromUnits(50000), "2023-02-17", "21:17", ""});
+    insert(Ledger::Income, {0, 6, 3, Money::fromUnits(60000), "2023-03-06", "12:42", ""});
+}
+
+std::pair<std::size_t, std::size_t> MemoryStorage::bounds(const LedgerData &ledgerData, const Range &range) const {
+    const ColumnStore &columns = ledgerData.columns;
+    int begin = parseDate(range.begin);
+    int end = parseDate(range.end);
+    std::size_t first = columns.lowerBound({begin, INT_MIN, INT_MIN});
+    std::size_t last = columns.lowerBound({end + 1, INT_MIN, INT_MIN});
+    if (range.page) {
+        ColumnStore::Key after{parseDate(range.page->date), parseTime(range.page->time), range.page->id};
+        first = std::max(first, columns.upperBound(after));
+    }
+    return {first, std::max(first, last)};
+}
+
+void MemoryStorage::validate(Ledger ledger, const Operation &operation) const {
+    if (!accounts.contains(operation.id_account)) {
+        throw std::runtime_error("Account doesn't exist");
+    }
+    if (!data(ledger).categories.contains(operation.id_cat)) {
+        throw std::runtime_error("Category doesn't exist");
+    }
+}
+
+int MemoryStorage::insert(Ledger ledger, const Operation &operation) {
+    LedgerData &ledgerData = data(ledger);
+    int id = operation.id != 0 ? operation.id : ledgerData.nextId;
+    ledgerData.nextId = std::max(ledgerData.nextId, id + 1);
+    ledgerData.columns.insert({id, parseDate(operation.date), parseTime(operation.time), operation.amount,
+                               operation.id_cat, operation.id_account});
+    if (operation.comment) {
+        ledgerData.comments[id] = *operation.comment;
+    }
+    return id;
+}
+
+Operation MemoryStorage::operation(const LedgerData &ledgerData, std::size_t row) {
+    ColumnStore::Row found = ledgerData.columns.row(row);
+    auto comment = ledgerData.comments.find(found.id);
+    return {found.id, found.id_cat, found.id_account, found.amount, formatDate(found.day), formatTime(found.seconds),
+            comment != ledgerData.comments.end() ? std::optional(comment->second) : std::nullopt};
+}
+
+void MemoryStorage::applyToBalance(Ledger ledger, int id_account, Money amount) {
+    // Expenses take money from the account, income adds it
+    auto account = accounts.find(id_account);
+    if (account != accounts.end()) {
+        account->second.amount += ledger == Ledger::Expenses ? -amount : amount;
+    }
+}
+
+std::vector<Account> MemoryStorage::listAccounts() {
+    std::shared_lock lock(mutex);
+    std::vector<Account> list;
+    list.reserve(accounts.size());
+    for (const auto &[id, account] : accounts) {
+        list.push_back(account);
+    }
+    return list;
+}
+
+std::optional<Account> MemoryStorage::findAccount(int id) {
+    std::shared_lock lock(mutex);
+    auto account = accounts.find(id);
+    if (account == accounts.end()) {
+        return std::nullopt;
+    }
+    return account->second;
+}
+
+int MemoryStorage::addAccount(const std::string &name, Money amount) {
+    std::unique_lock lock(mutex);
+    int id = nextAccount++;
+    accounts.emplace(id, Account{id, name, amount});
+    return id;
+}
+
+bool MemoryStorage::modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) {
+    std::unique_lock lock(mutex);
+    auto account = accounts.find(id);
+    if (account == accounts.end()) {
+        return false;
+    }
+    account->second.name = name.value_or(account->second.name);
+    account->second.amount = amount.value_or(account->second.amount);
+    return true;
+}
+
+bool MemoryStorage::deleteAccount(int id) {
+    std::unique_lock lock(mutex);
+    if (accounts.erase(id) == 0) {
+        return false;
+    }
+    for (auto &ledgerData : ledgers) {
+        for (int erased : ledgerData.columns.eraseAccount(id)) {
+            ledgerData.comments.erase(erased);
+        }
+    }
+    return true;
+}
+
+std::vector<Category> MemoryStorage::listCategories(Ledger ledger) {
+    std::shared_lock lock(mutex);
+    std::vector<Category> list;
+    for (const auto &[id, name] : data(ledger).categories) {
+        list.push_back({id, name});
+    }
+    return list;
+}
+
+int MemoryStorage::addCategory(Ledger ledger, const std::string &name) {
+    std::unique_lock lock(mutex);
+    LedgerData &ledgerData = data(ledger);
+    int id = ledgerData.nextCategory++;
+    ledgerData.categories.emplace(id, name);
+    return id;
+}
+
+bool MemoryStorage::renameCategory(Ledger ledger, int id, const std::string &name) {
+    std::unique_lock lock(mutex);
+    auto category = data(ledger).categories.find(id);
+    if (category == data(ledger).categories.end()) {
+        return false;
+    }
+    category->second = name;
+    return true;
+}
+
+bool MemoryStorage::deleteCategory(Ledger ledger, int id) {
+    std::unique_lock lock(mutex);
+    LedgerData &ledgerData = data(ledger);
+    if (ledgerData.categories.erase(id) == 0) {
+        return false;
+    }
+    ledgerData.columns.moveCategory(id, OTHER_CATEGORY_ID);
+    return true;
+}
+
+std::optional<Operation> MemoryStorage::findOperation(Ledger ledger, int id) {
+    std::shared_lock lock(mutex);
+    const LedgerData &ledgerData = data(ledger);
+    std::optional<std::size_t> row = ledgerData.columns.position(id);
+    if (!row) {
+        return std::nullopt;
+    }
+    return operation(ledgerData, *row);
+}
+
+int MemoryStorage::addOperation(Ledger ledger, const Operation &operation) {
+    std::unique_lock lock(mutex);
+    validate(ledger, operation);
+    Operation added = operation;
+    added.id = 0; // Ids are assigned here, like serial columns
+    int id = insert(ledger, added);
+    applyToBalance(ledger, operation.id_account, operation.amount);
+    return id;
+}
+
+void MemoryStorage::addOperations(Ledger ledger, std::span<const Operation> operations) {
+    std::unique_lock lock(mutex);
+    // Everything is checked before the first row goes in, so a failure leaves no trace
+    for (std::size_t i = 0; i < operations.size(); ++i) {
+        try {
+            validate(ledger, operations[i]);
+            parseDate(operations[i].date);
+            parseTime(operations[i].time);
+        } catch (std::exception &e) {
+            throw std::runtime_error("Operation " + std::to_string(i + 1) + ": " + e.what());
+        }
+    }
+    for (const auto &operation : operations) {
+        Operation added = operation;
+        added.id = 0;
+        insert(ledger, added);
+        applyToBalance(ledger, operation.id_account, operation.amount);
+    }
+}
+
+bool MemoryStorage::modifyOperation(Ledger ledger, int id, const OperationChange &change) {
+    std::unique_lock lock(mutex);
+    LedgerData &ledgerData = data(ledger);
+    std::optional<std::size_t> row = ledgerData.columns.position(id);
+    if (!row) {
+        return false;
+    }
+    Operation old = operation(ledgerData, *row);
+    Operation updated = old;
+    updated.id_cat = change.id_cat.value_or(old.id_cat);
+    updated.id_account = change.id_account.value_or(old.id_account);
+    updated.amount = change.amount.value_or(old.amount);
+    updated.date = change.date.value_or(old.date);
+    updated.time = change.time.value_or(old.time);
+    if (change.comment) {
+        updated.comment = change.comment;
+    }
+    validate(ledger, updated);
+    parseDate(updated.date);
+    parseTime(updated.time);
+
+    ledgerData.columns.erase(id);
+    ledgerData.comments.erase(id);
+    insert(ledger, updated); // Keeps its id, may move to another position
+    applyToBalance(ledger, old.id_account, -old.amount);
+    applyToBalance(ledger, updated.id_account, updated.amount);
+    return true;
+}
+
+bool MemoryStorage::deleteOperation(Ledger ledger, int id) {
+    // Like the Postgres storage, the balance of the account isn't restored
+    std::unique_lock lock(mutex);
+    LedgerData &ledgerData = data(ledger);
+    if (!ledgerData.columns.erase(id)) {
+        return false;
+    }
+    ledgerData.comments.erase(id);
+    return true;
+}
+
+std::vector<Operation> MemoryStorage::listOperations(Ledger ledger, const Range &range) {
+    std::shared_lock lock(mutex);
+    const LedgerData &ledgerData = data(ledger);
+    const ColumnStore &columns = ledgerData.columns;
+    auto [first, last] = bounds(ledgerData, range);
+    std::size_t limit = range.page ? static_cast<std::size_t>(std::max(range.page->limit, 0)) : last - first;
+
+    std::vector<Operation> operations;
+    operations.reserve(range.id_cat ? 0 : std::min(limit, last - first));
+    for (std::size_t row = first; row < last && operations.size() < limit; ++row) {
+        if (!range.id_cat || columns.category(row) == *range.id_cat) {
+            operations.push_back(operation(ledgerData, row));
+        }
+    }
+    return operations;
+}
+
+void MemoryStorage::scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) {
+    // The lock is held for one batch at a time, the next one continues after the last row handed over
+    std::optional<ColumnStore::Key> after;
+    std::vector<Operation> batch;
+    batch.reserve(batchRows);
+    while (true) {
+        batch.clear();
+        {
+            std::shared_lock lock(mutex);
+            const LedgerData &ledgerData = data(ledger);
+            const ColumnStore &columns = ledgerData.columns;
+            auto [first, last] = bounds(ledgerData, range);
+            if (after) {
+                first = std::max(first, columns.upperBound(*after));
+            }
+            for (std::size_t row = first; row < last && batch.size() < batchRows; ++row) {
+                if (!range.id_cat || columns.category(row) == *range.id_cat) {
+                    batch.push_back(operation(ledgerData, row));
+                    after = columns.key(row);
+                }
+            }
+        }
+        bool last = batch.size() < batchRows;
+        if (!sink(batch, last) || last) {
+            return;
+        }
+    }
+}
+
+std::vector<SummaryRow> MemoryStorage::summary(Ledger ledger, const std::string &begin, const std::string &end,
+                                               SummaryBy by, const std::string &period) {
+    int first = parseDate(begin);
+    int last = parseDate(end);
+    std::shared_lock lock(mutex);
+    return data(ledger).columns.summary(first, last, by, period);
+}
+
+void MemoryStorage::writeMetrics(ArenaString &out) const {
+    std::shared_lock lock(mutex);
+    Metrics::gauge(out, "finance_memory_expenses", "Expenses held by the in-memory storage.",
+                   static_cast<double>(data(Ledger::Expenses).columns.size()));
+    Metrics::gauge(out, "finance_memory_income", "Income held by the in-memory storage.",
+                   static_cast<double>(data(Ledger::Income).columns.size()));
+}
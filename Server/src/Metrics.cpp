@@ -0,0 +1,270 @@
+#include "Server/Metrics.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <utility>
+
+#define METRICS_FIRST_EXPOSED_BITS 2 // Histogram bounds from 4us up, one per power of two
+
+namespace {
+    const std::array<std::string_view, METRICS_PHASES + 1> phaseNames = {"parse", "db", "serialize", "write", "total"};
+    const std::array<std::string_view, 6> statusNames = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+    const std::array<double, 4> quantiles = {0.5, 0.9, 0.99, 0.999};
+
+    void append(ArenaString &out, std::uint64_t value) {
+        char text[24];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+
+    void append(ArenaString &out, double value) {
+        char text[32];
+        auto result = std::to_chars(text, text + sizeof(text), value);
+        out.append(text, result.ptr);
+    }
+
+    void header(ArenaString &out, std::string_view name, std::string_view help, std::string_view type) {
+        out.append("# HELP ").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+    void routeLabels(ArenaString &out, const RouteLabel &route) {
+        out.append("method=\"").append(route.method).append("\",route=\"").append(route.path).append("\"");
+    }
+
+    double seconds(std::uint64_t microseconds) {
+        return static_cast<double>(microseconds) / 1e6;
+    }
+}
+
+void PhaseTimer::start() {
+    spent.fill(std::chrono::nanoseconds{0});
+    current = Phase::Parse;
+    started = since = clock::now();
+}
+
+Phase PhaseTimer::enter(Phase phase) {
+    auto now = clock::now();
+    spent[static_cast<std::size_t>(current)] += now - since;
+    since = now;
+    return std::exchange(current, phase);
+}
+
+void PhaseTimer::stop() {
+    enter(current);
+}
+
+std::chrono::nanoseconds PhaseTimer::total() const {
+    std::chrono::nanoseconds result{0};
+    for (auto phase : spent) {
+        result += phase;
+    }
+    return result;
+}
+
+std::size_t Metrics::bucketOf(std::uint64_t microseconds) {
+    // Values below 2^SUB_BUCKET_BITS get a bucket each, every power of two above is split in 2^SUB_BUCKET_BITS
+    microseconds = std::min<std::uint64_t>(microseconds, (std::uint64_t{1} << METRICS_MAX_MICROSECONDS_BITS) - 1);
+    if (microseconds < (1u << METRICS_SUB_BUCKET_BITS)) {
+        return static_cast<std::size_t>(microseconds);
+    }
+    int exponent = std::bit_width(microseconds) - 1;
+    int shift = exponent - METRICS_SUB_BUCKET_BITS;
+    std::size_t sub = (microseconds >> shift) & ((1u << METRICS_SUB_BUCKET_BITS) - 1);
+    return (static_cast<std::size_t>(shift + 1) << METRICS_SUB_BUCKET_BITS) + sub;
+}
+
+std::uint64_t Metrics::bucketLimit(std::size_t bucket) {
+    if (bucket < (1u << METRICS_SUB_BUCKET_BITS)) {
+        return bucket + 1;
+    }
+    std::size_t shift = (bucket >> METRICS_SUB_BUCKET_BITS) - 1;
+    std::uint64_t sub = bucket & ((1u << METRICS_SUB_BUCKET_BITS) - 1);
+    return ((std::uint64_t{1} << METRICS_SUB_BUCKET_BITS) + sub + 1) << shift;
+}
+
+void Metrics::Histogram::record(std::uint64_t microseconds) {
+    buckets[bucketOf(microseconds)].add(1);
+    sumMicroseconds.add(microseconds);
+}
+
+Metrics &Metrics::get() {
+    static Metrics metrics;
+    return metrics;
+}
+
+Metrics::Shard &Metrics::local() {
+    // Shards stay registered after their thread exits, so its counts aren't lost
+    thread_local Shard *shard = nullptr;
+    if (shard == nullptr) {
+        auto fresh = std::make_unique<Shard>();
+        shard = fresh.get();
+        std::lock_guard lock(shardsMutex);
+        shards.push_back(std::move(fresh));
+    }
+    return *shard;
+}
+
+void Metrics::record(std::size_t route, unsigned status, const PhaseTimer &timer) {
+    RouteCounters &counters = local().routes[std::min<std::size_t>(route, METRICS_MAX_ROUTES)];
+    counters.statuses[status >= 100 && status < 600 ? status / 100 : 0].add(1);
+
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+    for (std::size_t phase = 0; phase < METRICS_PHASES; ++phase) {
+        counters.latency[phase].record(duration_cast<microseconds>(timer.spentIn(static_cast<Phase>(phase))).count());
+    }
+    counters.latency[METRICS_PHASES].record(duration_cast<microseconds>(timer.total()).count());
+}
+
+void Metrics::write(ArenaString &out, std::span<const RouteLabel> routes) const {
+    // Shards are summed into one set of counters first, so every route is written from the same totals
+    struct Totals {
+        std::array<std::uint64_t, 6> statuses{};
+        std::array<std::array<std::uint64_t, METRICS_BUCKETS>, METRICS_PHASES + 1> buckets{};
+        std::array<std::uint64_t, METRICS_PHASES + 1> sums{};
+        std::uint64_t requests = 0;
+    };
+    auto totals = std::make_unique<std::array<Totals, METRICS_MAX_ROUTES + 1>>();
+    {
+        std::lock_guard lock(shardsMutex);
+        for (const auto &shard : shards) {
+            for (std::size_t route = 0; route <= METRICS_MAX_ROUTES; ++route) {
+                const RouteCounters &counters = shard->routes[route];
+                Totals &total = (*totals)[route];
+                for (std::size_t status = 0; status < total.statuses.size(); ++status) {
+                    total.statuses[status] += counters.statuses[status].load();
+                }
+                for (std::size_t phase = 0; phase <= METRICS_PHASES; ++phase) {
+                    for (std::size_t bucket = 0; bucket < METRICS_BUCKETS; ++bucket) {
+                        total.buckets[phase][bucket] += counters.latency[phase].buckets[bucket].load();
+                    }
+                    total.sums[phase] += counters.latency[phase].sumMicroseconds.load();
+                }
+            }
+        }
+    }
+
+    static const RouteLabel unrouted{"", "unrouted"};
+    auto labelOf = [&](std::size_t route) -> const RouteLabel & {
+        return route < routes.size() && route < METRICS_MAX_ROUTES ? routes[route] : unrouted;
+    };
+    std::vector<std::size_t> active; // Routes that served at least one request
+    for (std::size_t route = 0; route <= METRICS_MAX_ROUTES; ++route) {
+        Totals &total = (*totals)[route];
+        for (auto count : total.statuses) {
+            total.requests += count;
+        }
+        if (total.requests != 0) {
+            active.push_back(route);
+        }
+    }
+
+    header(out, "finance_requests_total", "Requests served by route and status class.", "counter");
+    for (auto route : active) {
+        const Totals &total = (*totals)[route];
+        for (std::size_t status = 0; status < total.statuses.size(); ++status) {
+            if (total.statuses[status] == 0) {
+                continue;
+            }
+            out.append("finance_requests_total{");
+            routeLabels(out, labelOf(route));
+            out.append(",code=\"").append(statusNames[status]).append("\"} ");
+            append(out, total.statuses[status]);
+            out.append("\n");
+        }
+    }
+
+    header(out, "finance_request_duration_seconds",
+           "Request latency by route and phase; phase \"total\" is the whole request.", "histogram");
+    for (auto route : active) {
+        const Totals &total = (*totals)[route];
+        for (std::size_t phase = 0; phase <= METRICS_PHASES; ++phase) {
+            std::uint64_t cumulative = 0;
+            std::size_t bucket = 0;
+            for (int bits = METRICS_FIRST_EXPOSED_BITS; bits <= METRICS_MAX_MICROSECONDS_BITS; ++bits) {
+                std::uint64_t bound = std::uint64_t{1} << bits;
+                for (; bucket < METRICS_BUCKETS && bucketLimit(bucket) <= bound; ++bucket) {
+                    cumulative += total.buckets[phase][bucket];
+                }
+                out.append("finance_request_duration_seconds_bucket{");
+                routeLabels(out, labelOf(route));
+                out.append(",phase=\"").append(phaseNames[phase]).append("\",le=\"");
+                append(out, seconds(bound));
+                out.append("\"} ");
+                append(out, cumulative);
+                out.append("\n");
+            }
+            for (; bucket < METRICS_BUCKETS; ++bucket) {
+                cumulative += total.buckets[phase][bucket]; // Counted from the buckets, a scrape may race a record()
+            }
+            out.append("finance_request_duration_seconds_bucket{");
+            routeLabels(out, labelOf(route));
+            out.append(",phase=\"").append(phaseNames[phase]).append("\",le=\"+Inf\"} ");
+            append(out, cumulative);
+            out.append("\nfinance_request_duration_seconds_sum{");
+            routeLabels(out, labelOf(route));
+            out.append(",phase=\"").append(phaseNames[phase]).append("\"} ");
+            append(out, seconds(total.sums[phase]));
+            out.append("\nfinance_request_duration_seconds_count{");
+            routeLabels(out, labelOf(route));
+            out.append(",phase=\"").append(phaseNames[phase]).append("\"} ");
+            append(out, cumulative);
+            out.append("\n");
+        }
+    }
+
+    // Quantiles from the fine-grained buckets, reported as the upper limit of the bucket they fall in
+    header(out, "finance_request_latency_quantile_seconds", "Whole request latency quantiles by route.", "gauge");
+    for (auto route : active) {
+        const Totals &total = (*totals)[route];
+        const auto &buckets = total.buckets[METRICS_PHASES];
+        std::uint64_t count = 0;
+        for (auto bucket : buckets) {
+            count += bucket;
+        }
+        for (double quantile : quantiles) {
+            auto rank = static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(count)));
+            std::uint64_t cumulative = 0;
+            std::size_t bucket = 0;
+            for (; bucket + 1 < METRICS_BUCKETS; ++bucket) {
+                cumulative += buckets[bucket];
+                if (cumulative >= rank) {
+                    break;
+                }
+            }
+            out.append("finance_request_latency_quantile_seconds{");
+            routeLabels(out, labelOf(route));
+            out.append(",quantile=\"");
+            append(out, quantile);
+            out.append("\"} ");
+            append(out, seconds(bucketLimit(bucket)));
+            out.append("\n");
+        }
+    }
+
+    gauge(out, "finance_connections", "Open client connections.",
+          static_cast<double>(openConnections.load(std::memory_order_relaxed)));
+    counter(out, "finance_connections_refused_total", "Connections refused over the connection limit.",
+            static_cast<double>(refusedConnections.load(std::memory_order_relaxed)));
+    counter(out, "finance_requests_shed_total", "Requests answered 503 while the database queue was over its target.",
+            static_cast<double>(shedRequests.load(std::memory_order_relaxed)));
+    counter(out, "finance_connection_timeouts_total", "Connections closed on an idle or write timeout.",
+            static_cast<double>(timeouts.load(std::memory_order_relaxed)));
+}
+
+void Metrics::gauge(ArenaString &out, std::string_view name, std::string_view help, double value) {
+    header(out, name, help, "gauge");
+    out.append(name).append(" ");
+    append(out, value);
+    out.append("\n");
+}
+
+void Metrics::counter(ArenaString &out, std::string_view name, std::string_view help, double value) {
+    header(out, name, help, "counter");
+    out.append(name).append(" ");
+    append(out, value);
+    out.append("\n");
+}
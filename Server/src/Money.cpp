@@ -0,0 +1,81 @@
+#include "Server/Money.h"
+
+#include <limits>
+
+std::from_chars_result fromChars(const char *first, const char *last, Money &money) {
+    const char *pos = first;
+    bool negative = pos != last && *pos == '-';
+    if (negative) {
+        pos++;
+    }
+
+    // Units are accumulated as a negative number, which also covers the smallest amount
+    constexpr std::int64_t lowest = std::numeric_limits<std::int64_t>::min();
+    std::int64_t minor = 0;
+    bool overflow = false;
+    auto append = [&](char digit) {
+        int d = digit - '0';
+        if (minor < (lowest + d) / 10) {
+            overflow = true;
+        } else {
+            minor = minor * 10 - d;
+        }
+    };
+
+    const char *digits = pos;
+    while (pos != last && *pos >= '0' && *pos <= '9') {
+        append(*pos++);
+    }
+    if (pos == digits) {
+        return {first, std::errc::invalid_argument};
+    }
+
+    int fraction = 0;
+    if (pos != last && *pos == '.' && pos + 1 != last && pos[1] >= '0' && pos[1] <= '9') {
+        pos++;
+        while (fraction < 2 && pos != last && *pos >= '0' && *pos <= '9') {
+            append(*pos++);
+            fraction++;
+        }
+    }
+    for (; fraction < 2; ++fraction) {
+        append('0');
+    }
+
+    if (overflow || (!negative && minor == lowest)) {
+        return {pos, std::errc::result_out_of_range};
+    }
+    money = Money::fromMinor(negative ? minor : -minor);
+    return {pos, std::errc()};
+}
+
+std::to_chars_result toChars(char *first, char *last, Money money) {
+    std::int64_t minor = money.minor();
+    // Unsigned, so negating the smallest amount doesn't overflow
+    std::uint64_t magnitude = minor < 0 ? 0 - static_cast<std::uint64_t>(minor) : static_cast<std::uint64_t>(minor);
+    if (minor < 0) {
+        if (first == last) {
+            return {last, std::errc::value_too_large};
+        }
+        *first++ = '-';
+    }
+
+    auto [end, error] = std::to_chars(first, last, magnitude / MONEY_SCALE);
+    if (error != std::errc()) {
+        return {end, error};
+    }
+    auto cents = static_cast<unsigned>(magnitude % MONEY_SCALE);
+    if (cents == 0) {
+        return {end, std::errc()};
+    }
+    int length = cents % 10 == 0 ? 2 : 3;
+    if (last - end < length) {
+        return {last, std::errc::value_too_large};
+    }
+    end[0] = '.';
+    end[1] = static_cast<char>('0' + cents / 10);
+    if (length == 3) {
+        end[2] = static_cast<char>('0' + cents % 10);
+    }
+    return {end + length, std::errc()};
+}
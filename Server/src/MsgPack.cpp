@@ -0,0 +1,326 @@
+#include "Server/MsgPack.h"
+
+#include <bit>
+#include <limits>
+#include <string>
+
+#define MSGPACK_RESERVED_HEADER 5 // map32 or array32: type byte and a 32-bit count
+#define MSGPACK_FIXEXT8 '\xd7'
+#define MSGPACK_EXT_MONEY 1 // fixext 8 whose data is a big-endian int64 of minor units
+
+namespace {
+    template<class T>
+    void appendBigEndian(ArenaString &out, T value) {
+        char bytes[sizeof(T)];
+        for (std::size_t i = 0; i < sizeof(T); ++i) {
+            bytes[i] = static_cast<char>(static_cast<std::uint64_t>(value) >> (8 * (sizeof(T) - 1 - i)));
+        }
+        out.append(bytes, sizeof(T));
+    }
+
+    void writeBigEndian(char *at, std::uint64_t value, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            at[i] = static_cast<char>(value >> (8 * (size - 1 - i)));
+        }
+    }
+
+    class Decoder {
+    private:
+        std::string_view data;
+        std::size_t pos = 0;
+        DocumentSink &out;
+
+    public:
+        Decoder(std::string_view data, DocumentSink &out) : data(data), out(out) {}
+
+        [[noreturn]] void fail(const char *what) const {
+            throw EncodingError(std::string(what) + " at offset " + std::to_string(pos));
+        }
+
+        bool atEnd() const { return pos == data.size(); }
+
+        std::uint8_t byte() {
+            if (pos >= data.size()) {
+                fail("Unexpected end of MessagePack");
+            }
+            return static_cast<std::uint8_t>(data[pos++]);
+        }
+
+        std::uint64_t bigEndian(std::size_t size) {
+            std::uint64_t value = 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                value = value << 8 | byte();
+            }
+            return value;
+        }
+
+        std::string_view bytes(std::uint64_t size) {
+            if (size > data.size() - pos) {
+                fail("Unexpected end of MessagePack");
+            }
+            std::string_view result = data.substr(pos, size);
+            pos += size;
+            return result;
+        }
+
+        // Length of a string with the given type byte, false for anything else
+        bool string(std::uint8_t type, std::uint64_t &size) {
+            if ((type & 0xe0) == 0xa0) {
+                size = type & 0x1f;
+            } else if (type >= 0xd9 && type <= 0xdb) {
+                size = bigEndian(std::size_t{1} << (type - 0xd9));
+            } else {
+                return false;
+            }
+            return true;
+        }
+
+        void item(int depth) {
+            if (depth > ENCODER_MAX_DEPTH) {
+                fail("MessagePack is nested too deep");
+            }
+            std::uint8_t type = byte();
+            std::uint64_t size;
+            if (type <= 0x7f) {
+                out.value(std::int64_t{type});
+            } else if (type >= 0xe0) {
+                out.value(std::int64_t{static_cast<std::int8_t>(type)});
+            } else if (string(type, size)) {
+                out.value(bytes(size));
+            } else if ((type & 0xf0) == 0x80 || type == 0xde || type == 0xdf) {
+                size = (type & 0xf0) == 0x80 ? type & 0x0f : bigEndian(type == 0xde ? 2 : 4);
+                out.beginObject();
+                for (std::uint64_t i = 0; i < size; ++i) {
+                    std::uint64_t keySize;
+                    if (!string(byte(), keySize)) {
+                        fail("MessagePack map keys must be strings");
+                    }
+                    out.key(bytes(keySize));
+                    item(depth + 1);
+                }
+                out.endObject();
+            } else if ((type & 0xf0) == 0x90 || type == 0xdc || type == 0xdd) {
+                size = (type & 0xf0) == 0x90 ? type & 0x0f : bigEndian(type == 0xdc ? 2 : 4);
+                out.beginArray();
+                for (std::uint64_t i = 0; i < size; ++i) {
+                    item(depth + 1);
+                }
+                out.endArray();
+            } else {
+                scalar(type);
+            }
+        }
+
+        void scalar(std::uint8_t type) {
+            switch (type) {
+                case 0xc0: out.null(); return;
+                case 0xc2: out.value(false); return;
+                case 0xc3: out.value(true); return;
+                case 0xca: {
+                    auto bits = static_cast<std::uint32_t>(bigEndian(4));
+                    out.value(static_cast<double>(std::bit_cast<float>(bits)));
+                    return;
+                }
+                case 0xcb: out.value(std::bit_cast<double>(bigEndian(8))); return;
+                case 0xcc:
+                case 0xcd:
+                case 0xce: out.value(static_cast<std::int64_t>(bigEndian(std::size_t{1} << (type - 0xcc)))); return;
+                case 0xcf: {
+                    std::uint64_t value = bigEndian(8);
+                    if (value > static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max())) {
+                        out.value(static_cast<double>(value));
+                    } else {
+                        out.value(static_cast<std::int64_t>(value));
+                    }
+                    return;
+                }
+                case 0xd0: out.value(std::int64_t{static_cast<std::int8_t>(bigEndian(1))}); return;
+                case 0xd1: out.value(std::int64_t{static_cast<std::int16_t>(bigEndian(2))}); return;
+                case 0xd2: out.value(std::int64_t{static_cast<std::int32_t>(bigEndian(4))}); return;
+                case 0xd3: out.value(static_cast<std::int64_t>(bigEndian(8))); return;
+                case 0xd7:
+                    if (byte() != MSGPACK_EXT_MONEY) {
+                        fail("Unexpected MessagePack extension type");
+                    }
+                    out.value(Money::fromMinor(static_cast<std::int64_t>(bigEndian(8))));
+                    return;
+                default: fail("Unexpected MessagePack value");
+            }
+        }
+    };
+}
+
+void MsgPackWriter::element() {
+    if (!open.empty() && !open.back().map) {
+        open.back().count++;
+    }
+}
+
+void MsgPackWriter::begin(bool map) {
+    element();
+    open.push_back({out.size(), 0, map});
+    out.append(MSGPACK_RESERVED_HEADER, '\0');
+}
+
+void MsgPackWriter::end(bool map) {
+    if (open.empty() || open.back().map != map) {
+        throw std::logic_error("MessagePack container ended out of order");
+    }
+    Open container = open.back();
+    open.pop_back();
+    // The narrowest header goes in front of the elements, the bytes left over are cut out
+    char *at = out.data() + container.offset;
+    std::size_t size;
+    if (container.count < 16) {
+        at[0] = static_cast<char>((map ? 0x80 : 0x90) | container.count);
+        size = 1;
+    } else if (container.count <= 0xffff) {
+        at[0] = static_cast<char>(map ? 0xde : 0xdc);
+        writeBigEndian(at + 1, container.count, 2);
+        size = 3;
+    } else {
+        at[0] = static_cast<char>(map ? 0xdf : 0xdd);
+        writeBigEndian(at + 1, container.count, 4);
+        size = 5;
+    }
+    out.erase(container.offset + size, MSGPACK_RESERVED_HEADER - size);
+}
+
+MsgPackWriter &MsgPackWriter::beginObject() {
+    begin(true);
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::endObject() {
+    end(true);
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::beginArray() {
+    begin(false);
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::endArray() {
+    end(false);
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::key(std::string_view name) {
+    if (!open.empty() && open.back().map) {
+        open.back().count++; // Maps count pairs, so their values aren't counted
+    }
+    string(name);
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::value(std::string_view text) {
+    element();
+    string(text);
+    return *this;
+}
+
+void MsgPackWriter::string(std::string_view text) {
+    std::size_t size = text.size();
+    if (size < 32) {
+        out += static_cast<char>(0xa0 | size);
+    } else if (size <= 0xff) {
+        out += '\xd9';
+        appendBigEndian(out, static_cast<std::uint8_t>(size));
+    } else if (size <= 0xffff) {
+        out += '\xda';
+        appendBigEndian(out, static_cast<std::uint16_t>(size));
+    } else {
+        out += '\xdb';
+        appendBigEndian(out, static_cast<std::uint32_t>(size));
+    }
+    out += text;
+}
+
+MsgPackWriter &MsgPackWriter::value(std::int64_t number) {
+    element();
+    if (number >= 0 && number < 128) {
+        out += static_cast<char>(number);
+    } else if (number < 0 && number >= -32) {
+        out += static_cast<char>(number);
+    } else if (number > 0) {
+        if (number <= 0xff) {
+            out += '\xcc';
+            appendBigEndian(out, static_cast<std::uint8_t>(number));
+        } else if (number <= 0xffff) {
+            out += '\xcd';
+            appendBigEndian(out, static_cast<std::uint16_t>(number));
+        } else if (number <= 0xffffffff) {
+            out += '\xce';
+            appendBigEndian(out, static_cast<std::uint32_t>(number));
+        } else {
+            out += '\xcf';
+            appendBigEndian(out, static_cast<std::uint64_t>(number));
+        }
+    } else if (number >= std::numeric_limits<std::int8_t>::min()) {
+        out += '\xd0';
+        appendBigEndian(out, static_cast<std::uint8_t>(number));
+    } else if (number >= std::numeric_limits<std::int16_t>::min()) {
+        out += '\xd1';
+        appendBigEndian(out, static_cast<std::uint16_t>(number));
+    } else if (number >= std::numeric_limits<std::int32_t>::min()) {
+        out += '\xd2';
+        appendBigEndian(out, static_cast<std::uint32_t>(number));
+    } else {
+        out += '\xd3';
+        appendBigEndian(out, static_cast<std::uint64_t>(number));
+    }
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::value(double number) {
+    element();
+    out += '\xcb';
+    appendBigEndian(out, std::bit_cast<std::uint64_t>(number));
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::value(Money amount) {
+    element();
+    out += MSGPACK_FIXEXT8;
+    out += static_cast<char>(MSGPACK_EXT_MONEY);
+    appendBigEndian(out, static_cast<std::uint64_t>(amount.minor()));
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::value(bool flag) {
+    element();
+    out += flag ? '\xc3' : '\xc2';
+    return *this;
+}
+
+MsgPackWriter &MsgPackWriter::null() {
+    element();
+    out += '\xc0';
+    return *this;
+}
+
+ArenaString MsgPackWriter::release() {
+    open.clear();
+    return std::move(out);
+}
+
+void MsgPackWriter::consume() {
+    if (!open.empty()) {
+        throw std::logic_error("A MessagePack document can't be written in parts");
+    }
+    out.clear();
+}
+
+void MsgPackWriter::clear() {
+    open.clear();
+    out.clear();
+}
+
+void decodeMsgPack(std::string_view data, DocumentSink &out) {
+    Decoder decoder(data, out);
+    decoder.item(0);
+    if (!decoder.atEnd()) {
+        decoder.fail("Unexpected data after MessagePack document");
+    }
+}
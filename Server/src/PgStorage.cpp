@@ -0,0 +1,426 @@
+#include "Server/PgStorage.h"
+
+#include <Server/Metrics.h>
+#include <Server/ReferenceCache.h>
+
+#include <chrono>
+#include <map>
+#include <boost/asio/use_future.hpp>
+
+namespace {
+    // Expenses take money from the account, income adds it
+    const char *applyToBalance(Ledger ledger) {
+        return ledger == Ledger::Expenses ? "decreaseAccountAmount" : "increaseAccountAmount";
+    }
+
+    const char *revertOnBalance(Ledger ledger) {
+        return ledger == Ledger::Expenses ? "increaseAccountAmount" : "decreaseAccountAmount";
+    }
+
+    const char *table(Ledger ledger) {
+        return ledger == Ledger::Expenses ? "expenses" : "income";
+    }
+
+    const char *idColumn(Ledger ledger) {
+        return ledger == Ledger::Expenses ? "id_expense" : "id_income";
+    }
+
+    std::string foreignKeyError(const pqxx::foreign_key_violation &e) {
+        // Constraint names come from MEGAADDER.sql
+        if (std::string_view(e.what()).find("\"id_account\"") != std::string_view::npos) {
+            return "Account doesn't exist";
+        }
+        return "Category doesn't exist";
+    }
+
+    // Row of a pipelined result with the field interface of pqxx::row, so both are converted by the same code
+    class PipelinedRow {
+    private:
+        const AsyncResult &result;
+        int row;
+
+    public:
+        class Field {
+        private:
+            const AsyncResult &result;
+            int row;
+            int column;
+
+        public:
+            Field(const AsyncResult &result, int row, int column) : result(result), row(row), column(column) {}
+
+            bool is_null() const { return result.isNull(row, column); }
+            template<class T>
+            T as() const { return pqxx::from_string<T>(result.value(row, column)); }
+        };
+
+        PipelinedRow(const AsyncResult &result, int row) : result(result), row(row) {}
+
+        Field operator[](int column) const { return {result, row, column}; }
+    };
+
+    // Postgres array literal of the values, e.g. {1,2,3}
+    template<class T, class Project>
+    std::string arrayOf(const T &items, Project project) {
+        std::string text = "{";
+        for (const auto &item : items) {
+            text += project(item) + ",";
+        }
+        if (text.size() > 1) {
+            text.back() = '}';
+        } else {
+            text += '}';
+        }
+        return text;
+    }
+}
+
+PgStorage::PgStorage(DatabasePool &dbPool, AsyncDatabaseManager *pipeline) : dbPool(dbPool), pipeline(pipeline) {}
+
+DatabasePool::Handle PgStorage::acquire() {
+    try {
+        return dbPool.acquire();
+    } catch (std::exception &e) {
+        throw StorageUnavailable(e.what());
+    }
+}
+
+std::string PgStorage::statement(Ledger ledger, std::string_view prefix, std::string_view suffix) {
+    std::string name(prefix);
+    name += ledger == Ledger::Expenses ? "Expense" : "Income";
+    name += suffix;
+    return name;
+}
+
+template<class Row>
+Operation PgStorage::toOperation(const Row &row) {
+    Operation operation;
+    operation.id = row[0].template as<int>();
+    operation.id_cat = row[1].template as<int>();
+    operation.id_account = row[2].template as<int>();
+    operation.amount = row[3].template as<Money>();
+    operation.date = row[4].template as<std::string>();
+    operation.time = row[5].template as<std::string>();
+    if (!row[6].is_null()) {
+        operation.comment = row[6].template as<std::string>();
+    }
+    return operation;
+}
+
+template<class OnRow, class... Args>
+void PgStorage::read(const std::string &name, const OnRow &onRow, const Args &...args) {
+    if (pipeline != nullptr) {
+        AsyncResult result;
+        try {
+            result = pipeline->asyncExecPrepared(name, {pqxx::to_string(args)...}, boost::asio::use_future).get();
+        } catch (ConnectionLost &e) {
+            throw StorageUnavailable(e.what());
+        }
+        for (int row = 0; row < result.size(); ++row) {
+            onRow(PipelinedRow(result, row));
+        }
+        return;
+    }
+
+    auto db = acquire();
+    pqxx::read_transaction worker(db->GetConn());
+    pqxx::result result = worker.exec_prepared(name, args...);
+    worker.commit();
+    for (const auto &row : result) {
+        onRow(row);
+    }
+}
+
+std::vector<Account> PgStorage::listAccounts() {
+    std::vector<Account> accounts;
+    read("listAccounts", [&](const auto &row) {
+        accounts.push_back({row[0].template as<int>(), row[1].template as<std::string>(), Money()});
+    });
+    return accounts;
+}
+
+std::optional<Account> PgStorage::findAccount(int id) {
+    // Columns in table order: id_account, name, amount
+    std::optional<Account> account;
+    read("findAccount", [&](const auto &row) {
+        account = Account{row[0].template as<int>(), row[1].template as<std::string>(), row[2].template as<Money>()};
+    }, id);
+    return account;
+}
+
+int PgStorage::addAccount(const std::string &name, Money amount) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    pqxx::result res = worker.exec_prepared("addAccount", name, amount);
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return res[0][0].as<int>();
+}
+
+bool PgStorage::modifyAccount(int id, const std::optional<std::string> &name, std::optional<Money> amount) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    pqxx::result res = worker.exec_prepared("findAccount", id);
+    if (res.empty()) {
+        return false;
+    }
+    worker.exec_prepared("modifyAccount",
+                         name.value_or(res[0]["name"].as<std::string>()),
+                         amount.value_or(res[0]["amount"].as<Money>()),
+                         id);
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return true;
+}
+
+bool PgStorage::deleteAccount(int id) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    if (worker.exec_prepared("deleteAccount", id).affected_rows() == 0) {
+        return false;
+    }
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return true;
+}
+
+std::vector<Category> PgStorage::listCategories(Ledger ledger) {
+    std::vector<Category> categories;
+    read(statement(ledger, "list", "Categories"), [&](const auto &row) {
+        categories.push_back({row[0].template as<int>(), row[1].template as<std::string>()});
+    });
+    return categories;
+}
+
+int PgStorage::addCategory(Ledger ledger, const std::string &name) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    pqxx::result res = worker.exec_prepared(statement(ledger, "add", "Category"), name);
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return res[0][0].as<int>();
+}
+
+bool PgStorage::renameCategory(Ledger ledger, int id, const std::string &name) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    if (worker.exec_prepared(statement(ledger, "modify", "Category"), name, id).affected_rows() == 0) {
+        return false;
+    }
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return true;
+}
+
+bool PgStorage::deleteCategory(Ledger ledger, int id) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    worker.exec_prepared(statement(ledger, "change", "CategoryOther"), id);
+    worker.exec_prepared(statement(ledger, "change", "RollupOther"), id);
+    if (worker.exec_prepared(statement(ledger, "delete", "Category"), id).affected_rows() == 0) {
+        return false; // Rolled back
+    }
+    ReferenceCache::notify(worker);
+    worker.commit();
+    return true;
+}
+
+std::optional<Operation> PgStorage::findOperation(Ledger ledger, int id) {
+    std::optional<Operation> operation;
+    read(statement(ledger, "find"), [&](const auto &row) { operation = toOperation(row); }, id);
+    return operation;
+}
+
+int PgStorage::addOperation(Ledger ledger, const Operation &operation) {
+    auto db = acquire();
+    try {
+        pqxx::work worker(db->GetConn());
+        pqxx::result res = worker.exec_prepared(statement(ledger, "add"),
+                             operation.id_cat,
+                             operation.id_account,
+                             operation.amount,
+                             operation.date,
+                             operation.time,
+                             operation.comment.value_or(""));
+        worker.exec_prepared(statement(ledger, "change", "Rollup"),
+                             operation.id_cat,
+                             operation.id_account,
+                             operation.date,
+                             operation.amount,
+                             1);
+        worker.exec_prepared(applyToBalance(ledger), operation.amount, operation.id_account);
+        worker.commit();
+        return res[0][0].as<int>();
+    } catch (pqxx::foreign_key_violation &e) {
+        throw std::runtime_error(foreignKeyError(e));
+    }
+}
+
+void PgStorage::addOperations(Ledger ledger, std::span<const Operation> operations) {
+    // COPY the rows and apply one aggregated update for all accounts: a constant number of round trips
+    std::map<int, Money> deltas; // Balance change per id_account
+    for (const auto &operation : operations) {
+        deltas[operation.id_account] += ledger == Ledger::Expenses ? -operation.amount : operation.amount;
+    }
+    std::string accounts = arrayOf(deltas, [](const auto &delta) { return std::to_string(delta.first); });
+    std::string amounts = arrayOf(deltas, [](const auto &delta) { return pqxx::to_string(delta.second); });
+
+    // Rollup rows are grouped by the statement itself, dates may be spelled differently
+    std::string rollupCategories = arrayOf(operations, [](const Operation &o) { return std::to_string(o.id_cat); });
+    std::string rollupAccounts = arrayOf(operations, [](const Operation &o) { return std::to_string(o.id_account); });
+    std::string rollupDays = arrayOf(operations, [](const Operation &o) { return "\"" + o.date + "\""; });
+    std::string rollupAmounts = arrayOf(operations, [](const Operation &o) { return pqxx::to_string(o.amount); });
+
+    auto db = acquire();
+    try {
+        pqxx::work worker(db->GetConn());
+        auto stream = pqxx::stream_to::table(worker, {table(ledger)},
+                                             {"id_cat", "id_account", "amount", "date", "time", "comment"});
+        for (const auto &operation : operations) {
+            stream.write_values(operation.id_cat, operation.id_account, operation.amount,
+                                operation.date, operation.time, operation.comment.value_or(""));
+        }
+        stream.complete();
+        worker.exec_prepared("changeAccountAmounts", accounts, amounts);
+        worker.exec_prepared(statement(ledger, "change", "Rollups"),
+                             rollupCategories, rollupAccounts, rollupDays, rollupAmounts);
+        worker.commit();
+    } catch (pqxx::foreign_key_violation &e) {
+        throw std::runtime_error(foreignKeyError(e));
+    }
+}
+
+bool PgStorage::modifyOperation(Ledger ledger, int id, const OperationChange &change) {
+    auto db = acquire();
+    try {
+        pqxx::work worker(db->GetConn());
+        pqxx::result res = worker.exec_prepared(statement(ledger, "find"), id);
+        if (res.empty()) {
+            return false;
+        }
+        Operation old = toOperation(res[0]);
+        Operation updated = old;
+        updated.id_cat = change.id_cat.value_or(old.id_cat);
+        updated.id_account = change.id_account.value_or(old.id_account);
+        updated.amount = change.amount.value_or(old.amount);
+        updated.date = change.date.value_or(old.date);
+        updated.time = change.time.value_or(old.time);
+        if (change.comment) {
+            updated.comment = change.comment;
+        }
+
+        worker.exec_prepared(statement(ledger, "modify"),
+                             updated.id_cat,
+                             updated.id_account,
+                             updated.amount,
+                             updated.date,
+                             updated.time,
+                             updated.comment,
+                             id);
+        worker.exec_prepared(statement(ledger, "change", "Rollup"),
+                             old.id_cat, old.id_account, old.date, -old.amount, -1);
+        worker.exec_prepared(statement(ledger, "change", "Rollup"),
+                             updated.id_cat, updated.id_account, updated.date, updated.amount, 1);
+        worker.exec_prepared(revertOnBalance(ledger), old.amount, old.id_account);
+        worker.exec_prepared(applyToBalance(ledger), updated.amount, updated.id_account);
+        worker.commit();
+        return true;
+    } catch (pqxx::foreign_key_violation &e) {
+        throw std::runtime_error(foreignKeyError(e));
+    }
+}
+
+bool PgStorage::deleteOperation(Ledger ledger, int id) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    pqxx::result res = worker.exec_prepared(statement(ledger, "delete"), id);
+    if (res.empty()) {
+        return false;
+    }
+    worker.exec_prepared(statement(ledger, "change", "Rollup"),
+                         res[0]["id_cat"].as<int>(),
+                         res[0]["id_account"].as<int>(),
+                         res[0]["date"].as<std::string>(),
+                         -res[0]["amount"].as<Money>(),
+                         -1);
+    worker.commit();
+    return true;
+}
+
+std::vector<Operation> PgStorage::listOperations(Ledger ledger, const Range &range) {
+    std::vector<Operation> operations;
+    auto add = [&](const auto &row) { operations.push_back(toOperation(row)); };
+    if (range.id_cat && range.page) {
+        const Page &page = *range.page;
+        read(statement(ledger, "getBy", "CategoryPage"), add, *range.id_cat, range.begin, range.end,
+             page.date, page.time, page.id, page.limit);
+    } else if (range.id_cat) {
+        read(statement(ledger, "getBy", "Category"), add, *range.id_cat, range.begin, range.end);
+    } else if (range.page) {
+        const Page &page = *range.page;
+        read(statement(ledger, "get", "Page"), add, range.begin, range.end, page.date, page.time, page.id,
+             page.limit);
+    } else {
+        read(statement(ledger, "get"), add, range.begin, range.end);
+    }
+    return operations;
+}
+
+void PgStorage::scanOperations(Ledger ledger, const Range &range, std::size_t batchRows, const RowSink &sink) {
+    auto db = acquire();
+    pqxx::work worker(db->GetConn());
+    std::string select = std::string("SELECT * FROM ") + table(ledger) + " WHERE ";
+    if (range.id_cat) {
+        select += "id_cat=" + worker.quote(*range.id_cat) + " AND ";
+    }
+    select += "date BETWEEN " + worker.quote(range.begin) + " AND " + worker.quote(range.end);
+    select += std::string(" ORDER BY date, time, ") + idColumn(ledger);
+    worker.exec("DECLARE stream_rows NO SCROLL CURSOR FOR " + select);
+
+    const std::string fetch = "FETCH " + std::to_string(batchRows) + " FROM stream_rows";
+    std::vector<Operation> operations;
+    operations.reserve(batchRows);
+    while (true) {
+        pqxx::result batch = worker.exec(fetch);
+        operations.clear();
+        for (const auto &row : batch) {
+            operations.push_back(toOperation(row));
+        }
+        bool last = static_cast<std::size_t>(batch.size()) < batchRows;
+        if (!sink(operations, last)) {
+            return; // The transaction is rolled back
+        }
+        if (last) {
+            break;
+        }
+    }
+    worker.commit();
+}
+
+std::vector<SummaryRow> PgStorage::summary(Ledger ledger, const std::string &begin, const std::string &end,
+                                           SummaryBy by, const std::string &period) {
+    std::vector<SummaryRow> rows;
+    read(statement(ledger, "get", by == SummaryBy::Category ? "SummaryByCategory" : "SummaryByAccount"),
+         [&](const auto &row) {
+             rows.push_back({row[0].template as<int>(), row[1].template as<std::string>(),
+                             row[2].template as<Money>(), row[3].template as<long long>()});
+         },
+         begin, end, period);
+    return rows;
+}
+
+void PgStorage::writeMetrics(ArenaString &out) const {
+    DatabasePool::Stats pool = dbPool.stats();
+    Metrics::gauge(out, "finance_db_pool_size", "Connections in the database pool.", pool.size);
+    Metrics::gauge(out, "finance_db_pool_idle", "Idle connections in the database pool.", pool.idle);
+    Metrics::counter(out, "finance_db_pool_acquired_total", "Connections checked out of the pool.", pool.acquired);
+    Metrics::counter(out, "finance_db_pool_exhausted_total", "Checkouts that had to wait for a connection.",
+                     pool.exhausted);
+    Metrics::counter(out, "finance_db_pool_timeouts_total", "Checkouts that timed out.", pool.timeouts);
+    Metrics::counter(out, "finance_db_pool_reconnects_total", "Connections reopened by the health check.",
+                     pool.reconnects);
+    Metrics::counter(out, "finance_db_pool_wait_seconds_total", "Time spent waiting for a connection.",
+                     std::chrono::duration<double>(pool.totalWait).count());
+    Metrics::gauge(out, "finance_db_pool_wait_seconds_max", "Longest wait for a connection.",
+                   std::chrono::duration<double>(pool.maxWait).count());
+}
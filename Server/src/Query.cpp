@@ -0,0 +1,93 @@
+#include "Server/Query.h"
+
+namespace {
+    int hexDigit(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    bool isEncoded(std::string_view text) {
+        return text.find_first_of("%+") != std::string_view::npos;
+    }
+}
+
+bool Query::parse(std::string_view text) {
+    count = 0;
+    arena.release();
+
+    while (!text.empty()) {
+        auto end = text.find('&');
+        std::string_view pair = text.substr(0, end);
+        text = end == std::string_view::npos ? std::string_view{} : text.substr(end + 1);
+        if (pair.empty()) {
+            continue;
+        }
+        if (count == params.size()) {
+            return false;
+        }
+
+        auto pos = pair.find('=');
+        Param &param = params[count++];
+        param.key = pair.substr(0, pos);
+        param.value = pos == std::string_view::npos ? std::string_view{} : pair.substr(pos + 1);
+        param.encoded = isEncoded(param.value);
+        if (isEncoded(param.key)) {
+            param.key = decode(param.key); // Keys are compared on every lookup, so they are decoded right away
+        }
+    }
+    return true;
+}
+
+std::string_view Query::decode(std::string_view text) const {
+    char *out = static_cast<char *>(arena.allocate(text.size(), 1));
+    std::size_t size = 0;
+    for (std::size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '+') {
+            out[size++] = ' ';
+        } else if (text[i] == '%' && i + 2 < text.size() && hexDigit(text[i + 1]) >= 0 && hexDigit(text[i + 2]) >= 0) {
+            out[size++] = static_cast<char>(hexDigit(text[i + 1]) * 16 + hexDigit(text[i + 2]));
+            i += 2;
+        } else {
+            out[size++] = text[i]; // Malformed escapes are kept as they are
+        }
+    }
+    return {out, size};
+}
+
+Query::Param *Query::lookup(std::string_view key) const {
+    for (std::size_t i = 0; i < count; ++i) {
+        if (params[i].key == key) {
+            return &params[i];
+        }
+    }
+    return nullptr;
+}
+
+std::string_view Query::value(Param &param) const {
+    if (param.encoded) {
+        // Decoded once, the parameter then refers to the arena
+        param.value = decode(param.value);
+        param.encoded = false;
+    }
+    return param.value;
+}
+
+std::optional<std::string_view> Query::find(std::string_view key) const {
+    Param *param = lookup(key);
+    if (param == nullptr) {
+        return std::nullopt;
+    }
+    return value(*param);
+}
+
+std::pair<std::string_view, std::string_view> Query::at(std::size_t i) const {
+    return {params[i].key, value(params[i])};
+}
+
+bool Target::parse(std::string_view target) {
+    auto pos = target.find('?');
+    path = target.substr(0, pos);
+    return query.parse(pos == std::string_view::npos ? std::string_view{} : target.substr(pos + 1));
+}
@@ -0,0 +1,132 @@
+#include "Server/ReferenceCache.h"
+
+#include <Server/DatabaseManager.h>
+#include <Server/Logger.h>
+
+#include <chrono>
+
+#define REFERENCE_CHANNEL "reference_changed"
+
+namespace {
+    class ChangeReceiver : public pqxx::notification_receiver {
+    public:
+        bool changed = false;
+
+        explicit ChangeReceiver(pqxx::connection &conn) : pqxx::notification_receiver(conn, REFERENCE_CHANNEL) {}
+
+        void operator()(const std::string &, int) override {
+            changed = true;
+        }
+    };
+}
+
+const std::unordered_map<int, std::string> &ReferenceCache::Snapshot::table(Table table) const {
+    switch (table) {
+        case Table::Accounts:
+            return accounts;
+        case Table::ExpenseCategories:
+            return expenseCategories;
+        default:
+            return incomeCategories;
+    }
+}
+
+std::unordered_map<int, std::string> &ReferenceCache::Snapshot::table(Table table) {
+    return const_cast<std::unordered_map<int, std::string> &>(std::as_const(*this).table(table));
+}
+
+ReferenceCache::ReferenceCache() : snapshot(std::make_shared<const Snapshot>()) {}
+
+ReferenceCache::~ReferenceCache() {
+    stopping = true;
+    if (listener.joinable()) {
+        listener.join();
+    }
+}
+
+void ReferenceCache::load(pqxx::connection &conn) {
+    reload(conn);
+    if (!listener.joinable()) {
+        listener = std::thread([this] { listen(); });
+    }
+}
+
+void ReferenceCache::load(Storage &storage) {
+    auto fresh = std::make_shared<Snapshot>();
+    for (const auto &account : storage.listAccounts()) {
+        fresh->accounts.emplace(account.id, account.name);
+    }
+    for (const auto &category : storage.listCategories(Ledger::Expenses)) {
+        fresh->expenseCategories.emplace(category.id, category.name);
+    }
+    for (const auto &category : storage.listCategories(Ledger::Income)) {
+        fresh->incomeCategories.emplace(category.id, category.name);
+    }
+
+    std::lock_guard lock(writeMutex);
+    snapshot.store(std::move(fresh));
+}
+
+void ReferenceCache::reload(pqxx::connection &conn) {
+    auto fresh = std::make_shared<Snapshot>();
+    pqxx::read_transaction worker(conn);
+    for (const auto &row : worker.exec_prepared("listAccounts")) {
+        fresh->accounts.emplace(row[0].as<int>(), row[1].as<std::string>());
+    }
+    for (const auto &row : worker.exec_prepared("listExpenseCategories")) {
+        fresh->expenseCategories.emplace(row[0].as<int>(), row[1].as<std::string>());
+    }
+    for (const auto &row : worker.exec_prepared("listIncomeCategories")) {
+        fresh->incomeCategories.emplace(row[0].as<int>(), row[1].as<std::string>());
+    }
+    worker.commit();
+
+    std::lock_guard lock(writeMutex);
+    snapshot.store(std::move(fresh));
+}
+
+void ReferenceCache::listen() {
+    while (!stopping) {
+        try {
+            DatabaseManager manager;
+            ChangeReceiver receiver(manager.GetConn());
+            reload(manager.GetConn()); // Changes may have been missed while the listener was disconnected
+            while (!stopping) {
+                manager.GetConn().await_notification(1, 0);
+                if (receiver.changed) {
+                    receiver.changed = false;
+                    reload(manager.GetConn());
+                }
+            }
+        } catch (const std::exception &e) {
+            Logger::warning("Reference cache listener: ", e.what());
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+}
+
+std::shared_ptr<const ReferenceCache::Snapshot> ReferenceCache::get() const {
+    return snapshot.load();
+}
+
+bool ReferenceCache::contains(Table table, int id) const {
+    return get()->table(table).contains(id);
+}
+
+void ReferenceCache::put(Table table, int id, const std::string &name) {
+    std::lock_guard lock(writeMutex);
+    auto copy = std::make_shared<Snapshot>(*snapshot.load());
+    copy->table(table)[id] = name;
+    snapshot.store(std::move(copy));
+}
+
+void ReferenceCache::erase(Table table, int id) {
+    std::lock_guard lock(writeMutex);
+    auto copy = std::make_shared<Snapshot>(*snapshot.load());
+    copy->table(table).erase(id);
+    snapshot.store(std::move(copy));
+}
+
+void ReferenceCache::notify(pqxx::work &worker) {
+    worker.exec("NOTIFY " REFERENCE_CHANNEL);
+}
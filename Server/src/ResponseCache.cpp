@@ -0,0 +1,149 @@
+#include "Server/ResponseCache.h"
+
+#include <Server/Metrics.h>
+
+#include <cstring>
+
+ResponseCache::ResponseCache(std::size_t budget) : budget(budget) {}
+
+bool ResponseCache::fresh(const Entry &entry) const {
+    for (std::size_t tag = 0; tag < RESPONSE_CACHE_TAGS; ++tag) {
+        if ((entry.tags & (1u << tag)) != 0 && entry.generations[tag] != current[tag]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ResponseCache::erase(std::list<Entry>::iterator entry) {
+    used -= entry->key.size() + entry->response->body.size() + entry->response->encoded.size()
+            + RESPONSE_CACHE_ENTRY_OVERHEAD;
+    index.erase(entry->key);
+    entries.erase(entry);
+}
+
+std::shared_ptr<const ResponseCache::Response> ResponseCache::find(const std::string &key, Generations &seen) {
+    std::lock_guard lock(mutex);
+    seen = current;
+    auto found = index.find(key);
+    if (found == index.end()) {
+        misses++;
+        return nullptr;
+    }
+    if (!fresh(*found->second)) {
+        // Invalidated entries are dropped lazily, when they are looked up or fall off the end
+        erase(found->second);
+        misses++;
+        return nullptr;
+    }
+    entries.splice(entries.begin(), entries, found->second);
+    hits++;
+    return found->second->response;
+}
+
+void ResponseCache::put(const std::string &key, unsigned tags, const Generations &seen, Response &&response) {
+    std::size_t size = key.size() + response.body.size() + response.encoded.size() + RESPONSE_CACHE_ENTRY_OVERHEAD;
+    if (!enabled() || size > budget / 4) {
+        return;
+    }
+
+    Entry entry{key, tags, seen, std::make_shared<const Response>(std::move(response))};
+    std::lock_guard lock(mutex);
+    if (!fresh(entry)) {
+        return; // A write committed while the body was being read
+    }
+    if (auto found = index.find(key); found != index.end()) {
+        erase(found->second);
+    }
+    entries.push_front(std::move(entry));
+    index.emplace(entries.front().key, entries.begin());
+    used += size;
+    while (used > budget) {
+        erase(std::prev(entries.end()));
+        evictions++;
+    }
+}
+
+void ResponseCache::invalidate(unsigned tags) {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard lock(mutex);
+    for (std::size_t tag = 0; tag < RESPONSE_CACHE_TAGS; ++tag) {
+        if ((tags & (1u << tag)) != 0) {
+            current[tag]++;
+        }
+    }
+}
+
+void ResponseCache::writeMetrics(ArenaString &out) const {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard lock(mutex);
+    Metrics::counter(out, "finance_response_cache_hits_total", "GET responses served from the cache.",
+                     static_cast<double>(hits));
+    Metrics::counter(out, "finance_response_cache_misses_total", "GET responses that had to be built.",
+                     static_cast<double>(misses));
+    Metrics::counter(out, "finance_response_cache_evictions_total", "Entries evicted to stay within the budget.",
+                     static_cast<double>(evictions));
+    Metrics::gauge(out, "finance_response_cache_entries", "Responses in the cache.",
+                   static_cast<double>(entries.size()));
+    Metrics::gauge(out, "finance_response_cache_bytes", "Memory the cached responses take.",
+                   static_cast<double>(used));
+}
+
+std::uint64_t ResponseCache::hash(std::string_view body) {
+    // Eight bytes per step, each multiply is followed by a shift so the high bits reach the low ones too
+    constexpr std::uint64_t multiplier = 0x9e3779b97f4a7c15;
+    std::uint64_t hash = 0xcbf29ce484222325 ^ body.size();
+    std::size_t i = 0;
+    for (; i + 8 <= body.size(); i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, body.data() + i, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 29;
+    }
+    for (; i < body.size(); ++i) {
+        hash = (hash ^ static_cast<unsigned char>(body[i])) * multiplier;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+ResponseCache::ETag ResponseCache::etag(std::uint64_t hash, ContentEncoding encoding) {
+    hash ^= static_cast<std::uint64_t>(encoding) * 0x9e3779b97f4a7c15;
+
+    static constexpr char digits[] = "0123456789abcdef";
+    ETag etag;
+    etag.front() = '"';
+    etag.back() = '"';
+    for (std::size_t digit = 0; digit < 16; ++digit) {
+        etag[16 - digit] = digits[(hash >> (4 * digit)) & 0xf];
+    }
+    return etag;
+}
+
+bool ResponseCache::matches(std::string_view ifNoneMatch, std::string_view etag) {
+    while (!ifNoneMatch.empty()) {
+        auto end = ifNoneMatch.find(',');
+        std::string_view tag = ifNoneMatch.substr(0, end);
+        ifNoneMatch = end == std::string_view::npos ? std::string_view{} : ifNoneMatch.substr(end + 1);
+
+        auto first = tag.find_first_not_of(" \t");
+        if (first == std::string_view::npos) {
+            continue;
+        }
+        tag = tag.substr(first, tag.find_last_not_of(" \t") - first + 1);
+        if (tag == "*") {
+            return true;
+        }
+        if (tag.starts_with("W/")) {
+            tag.remove_prefix(2);
+        }
+        if (tag == etag) {
+            return true;
+        }
+    }
+    return false;
+}
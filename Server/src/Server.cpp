@@ -1,26 +1,106 @@
 #include <Server/Server.h>
 
-Server::Server(const net::ip::address &address, unsigned short port)
-    : acceptor{ioc, {address, port}}, socket{ioc} {}
+#include <Server/AnalyticsStorage.h>
+#include <Server/MemoryStorage.h>
+#include <Server/PgStorage.h>
+
+#include <algorithm>
+#include <atomic>
+
+Server::Server(const net::ip::address &address, unsigned short port, std::size_t dbPoolSize, std::size_t threads,
+               std::string_view storage, bool analytics, bool dbPipeline, std::size_t responseCacheBytes,
+               const Limits &limits)
+    : threads{std::max<std::size_t>(threads, 1)}, ioc{static_cast<int>(this->threads)}, acceptor{ioc, {address, port}},
+      // A pipelined read holds its storage thread until the result comes, so there are enough threads to fill the
+      // pipeline with the requests a connection reads ahead
+      dbExecutor{dbPipeline ? std::max<std::size_t>(dbPoolSize, PIPELINE_DEPTH) : dbPoolSize},
+      responseCache{responseCacheBytes}, limits{limits} {
+    if (storage == "postgres") {
+        dbPool = std::make_unique<DatabasePool>(dbPoolSize);
+        if (dbPipeline) {
+            this->dbPipeline = std::make_unique<AsyncDatabaseManager>(ioc.get_executor());
+        }
+        this->storage = std::make_unique<PgStorage>(*dbPool, this->dbPipeline.get());
+        auto db = dbPool->acquire();
+        referenceCache.load(db->GetConn());
+    } else if (storage == "memory") {
+        this->storage = std::make_unique<MemoryStorage>();
+        referenceCache.load(*this->storage);
+    } else {
+        throw std::runtime_error("Unknown storage: " + std::string(storage));
+    }
+    if (analytics) {
+        this->storage = std::make_unique<AnalyticsStorage>(std::move(this->storage));
+    }
+    Logger::info("Storage: ", storage);
+}
 
 void Server::AcceptClient() {
-    acceptor.async_accept(socket, [this](const beast::error_code &error) {
-        auto conn = Connection::create(std::move(socket));
-        std::cout << "Client accepted!\n";
+    // Each accepted socket gets its own strand, so a Connection's handlers never run concurrently
+    acceptor.async_accept(net::make_strand(ioc), [this](const beast::error_code &error, tcp::socket socket) {
+        Logger::debug("Client accepted");
 
-        if (!error) conn->start();
+        if (!error) {
+            if (Metrics::get().connections() >= static_cast<std::int64_t>(limits.maxConnections)) {
+                RefuseClient(std::move(socket));
+            } else {
+                Connection::create(std::move(socket), dbExecutor, *storage, referenceCache, responseCache, limits)
+                    ->start();
+            }
+        }
 
         AcceptClient();
     });
 }
 
+void Server::RefuseClient(tcp::socket &&socket) {
+    Metrics::get().connectionRefused();
+    Logger::debug("Client refused, connections are over the limit");
+    // Written without reading the request: a Connection costs more than a client refused in a burst is worth
+    auto refused = std::make_shared<tcp::socket>(std::move(socket));
+    auto response = std::make_shared<std::string>("HTTP/1.1 503 Service Unavailable\r\nRetry-After: "
+                                                  + std::to_string(limits.retryAfter.count())
+                                                  + "\r\nConnection: close\r\nContent-Length: 0\r\n\r\n");
+    net::async_write(*refused, net::buffer(*response), [refused, response](const beast::error_code &, std::size_t) {
+        beast::error_code ignored;
+        refused->shutdown(tcp::socket::shutdown_both, ignored);
+        refused->close(ignored);
+    });
+}
+
 int Server::run() {
     try {
         AcceptClient();
-        ioc.run();
+
+        // Whichever thread's run throws stops the io_context, so the others return and the workers are joined
+        // when they go out of scope
+        auto runOrStop = [this] {
+            try {
+                ioc.run();
+            } catch (...) {
+                ioc.stop();
+                throw;
+            }
+        };
+        std::atomic_bool workerFailed = false;
+        {
+            std::vector<std::jthread> workers;
+            workers.reserve(threads - 1);
+            for (std::size_t i = 1; i < threads; ++i) {
+                workers.emplace_back([&runOrStop, &workerFailed] {
+                    try {
+                        runOrStop();
+                    } catch (const std::exception &e) {
+                        Logger::error(e.what());
+                        workerFailed = true;
+                    }
+                });
+            }
+            runOrStop();
+        }
+        return workerFailed ? EXIT_FAILURE : EXIT_SUCCESS;
     } catch (const std::exception &e) {
-        std::cerr << e.what();
+        Logger::error(e.what());
         throw;
     }
-    return EXIT_SUCCESS;
 }
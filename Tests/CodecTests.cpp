@@ -0,0 +1,176 @@
+#include <Server/Cbor.h>
+#include <Server/Encoder.h>
+#include <Server/Json.h>
+#include <Server/MsgPack.h>
+
+#include <gtest/gtest.h>
+
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+    constexpr std::int64_t lowest = std::numeric_limits<std::int64_t>::min();
+    constexpr std::int64_t highest = std::numeric_limits<std::int64_t>::max();
+
+    // An operation as a handler writes it, with values at the edges of every encoding width
+    void writeOperation(Encoder &writer) {
+        writer.beginObject();
+        writer.key("id_cat").value(3);
+        writer.key("small").value(-32);
+        writer.key("byte").value(200);
+        writer.key("short").value(-40000);
+        writer.key("lowest").value(lowest);
+        writer.key("highest").value(highest);
+        writer.key("amount").value(Money::fromMinor(-5));
+        writer.key("smallest").value(Money::fromMinor(lowest));
+        writer.key("ratio").value(0.1);
+        writer.key("date").date("2022-12-12");
+        writer.key("comment").value(std::string(300, 'x'));
+        writer.key("empty").value("");
+        writer.key("flag").value(true);
+        writer.key("none").null();
+        writer.key("nested").beginObject().key("list").beginArray().value(1).value("a").endArray().endObject();
+        writer.endObject();
+    }
+
+    void expectOperation(const JsonObject &root) {
+        EXPECT_EQ(root.get<int>("id_cat"), 3);
+        EXPECT_EQ(root.get<int>("small"), -32);
+        EXPECT_EQ(root.get<int>("byte"), 200);
+        EXPECT_EQ(root.get<int>("short"), -40000);
+        EXPECT_EQ(root.get<long long>("lowest"), lowest);
+        EXPECT_EQ(root.get<long long>("highest"), highest);
+        EXPECT_EQ(root.get<Money>("amount").minor(), -5);
+        EXPECT_EQ(root.get<Money>("smallest").minor(), lowest);
+        EXPECT_DOUBLE_EQ(root.get<double>("ratio"), 0.1);
+        EXPECT_EQ(root.get<std::string>("date"), "2022-12-12");
+        EXPECT_EQ(root.get<std::string>("comment"), std::string(300, 'x'));
+        EXPECT_EQ(root.get<std::string>("empty"), "");
+        EXPECT_TRUE(root.get<bool>("flag"));
+        EXPECT_EQ(root.find("none")->type(), JsonValue::Type::Null);
+        EXPECT_EQ(root.find("nested")->type(), JsonValue::Type::Object);
+        EXPECT_FALSE(root.contains("list")); // Nested fields aren't collected
+    }
+
+    template<class Writer>
+    void expectRoundTrip(Format format) {
+        Writer writer;
+        writeOperation(writer);
+        expectOperation(JsonObject::decode(format, writer.str()));
+
+        JsonWriter json;
+        writeOperation(json);
+        expectOperation(JsonObject::parse(json.str()));
+    }
+
+    template<class Writer>
+    void expectArrayRoundTrip(Format format) {
+        Writer writer;
+        writer.beginArray();
+        for (int i = 0; i < 20; ++i) {
+            writer.beginObject().key("id").value(i).key("amount").value(Money::fromMinor(i * 150)).endObject();
+        }
+        writer.endArray();
+        std::vector<std::int64_t> amounts;
+        forEachDecodedObject(format, writer.str(), [&](const JsonObject &object) {
+            EXPECT_EQ(object.get<int>("id"), static_cast<int>(amounts.size()));
+            amounts.push_back(object.get<Money>("amount").minor());
+        });
+        ASSERT_EQ(amounts.size(), 20u);
+        EXPECT_EQ(amounts.back(), 19 * 150);
+    }
+}
+
+TEST(Cbor, RoundTrips) {
+    expectRoundTrip<CborWriter>(Format::Cbor);
+}
+
+TEST(Cbor, RoundTripsArraysOfMaps) {
+    expectArrayRoundTrip<CborWriter>(Format::Cbor);
+}
+
+TEST(Cbor, WritesAmountsAsDecimalFractions) {
+    CborWriter writer;
+    writer.value(Money::fromMinor(-5));
+    EXPECT_EQ(writer.str(), std::string_view("\xc4\x82\x21\x24", 4)); // 4([-2, -5])
+}
+
+TEST(Cbor, ReadsChunkedText) {
+    // {_ (_ "id", "x"): 5}, the key sent in two chunks
+    std::string_view data("\xbf\x7f\x62id\x61x\xff\x05\xff", 10);
+    EXPECT_EQ(JsonObject::decode(Format::Cbor, data).get<int>("idx"), 5);
+}
+
+TEST(Cbor, ConvertsNumbersLikeJson) {
+    CborWriter writer;
+    writer.beginObject().key("units").value(12).key("real").value(12.5).key("fraction").value(1.234);
+    writer.key("whole").value(Money::fromMinor(700)).endObject();
+    JsonObject root = JsonObject::decode(Format::Cbor, writer.str());
+    EXPECT_EQ(root.get<Money>("units").minor(), 1200);
+    EXPECT_EQ(root.get<Money>("real").minor(), 1250);
+    EXPECT_THROW(root.get<Money>("fraction"), JsonError);
+    EXPECT_THROW(root.get<int>("real"), JsonError);
+    EXPECT_EQ(root.get<int>("whole"), 7);
+    EXPECT_EQ(root.get<std::string>("real"), "12.5");
+}
+
+TEST(Cbor, RejectsMalformedData) {
+    // Cut short, a key that isn't text, a byte string, not a map, data after the map
+    for (std::string_view data : {std::string_view(""), std::string_view("\xa1\x61", 2),
+                                  std::string_view("\xa1\x01\x01", 3), std::string_view("\x41\x00", 2),
+                                  std::string_view("\x01", 1), std::string_view("\xa0\x00", 2)}) {
+        EXPECT_THROW(JsonObject::decode(Format::Cbor, data), EncodingError);
+    }
+}
+
+TEST(MsgPack, RoundTrips) {
+    expectRoundTrip<MsgPackWriter>(Format::MsgPack);
+}
+
+TEST(MsgPack, RoundTripsArraysOfMaps) {
+    expectArrayRoundTrip<MsgPackWriter>(Format::MsgPack);
+}
+
+TEST(MsgPack, WritesTheNarrowestHeaders) {
+    MsgPackWriter writer;
+    writer.beginArray();
+    for (int i = 0; i < 16; ++i) {
+        writer.beginObject().endObject();
+    }
+    writer.endArray();
+    EXPECT_EQ(writer.str(), std::string("\xdc\x00\x10", 3) + std::string(16, '\x80'));
+}
+
+TEST(MsgPack, WritesAmountsAsExtensions) {
+    MsgPackWriter writer;
+    writer.value(Money::fromMinor(-5));
+    EXPECT_EQ(writer.str(), std::string_view("\xd7\x01\xff\xff\xff\xff\xff\xff\xff\xfb", 10));
+}
+
+TEST(MsgPack, RejectsMalformedData) {
+    // Cut short, a key that isn't a string, binary data, another extension, not a map, data after the map
+    for (std::string_view data : {std::string_view(""), std::string_view("\x81\xa1", 2),
+                                  std::string_view("\x81\x01\x01", 3), std::string_view("\xc4\x01\x00", 3),
+                                  std::string_view("\xd7\x02\x00\x00\x00\x00\x00\x00\x00\x00", 10),
+                                  std::string_view("\x01", 1), std::string_view("\x80\x00", 2)}) {
+        EXPECT_THROW(JsonObject::decode(Format::MsgPack, data), EncodingError);
+    }
+}
+
+TEST(MsgPack, RefusesToStreamAnOpenContainer) {
+    MsgPackWriter writer;
+    writer.beginArray();
+    EXPECT_THROW(writer.consume(), std::logic_error);
+}
+
+TEST(Encoder, NegotiatesTheFormat) {
+    EXPECT_EQ(Encoder::negotiate(""), Format::Json);
+    EXPECT_EQ(Encoder::negotiate("*/*"), Format::Json);
+    EXPECT_EQ(Encoder::negotiate("application/cbor"), Format::Cbor);
+    EXPECT_EQ(Encoder::negotiate("application/json;q=0.5, application/x-msgpack"), Format::MsgPack);
+    EXPECT_EQ(Encoder::negotiate("application/msgpack, application/cbor;q=0.5", true), Format::Cbor);
+    EXPECT_FALSE(Encoder::accepts("application/msgpack", Encoder::negotiate("application/msgpack", true)));
+    EXPECT_TRUE(Encoder::accepts("application/msgpack, */*;q=0.1", Format::Json));
+}
@@ -0,0 +1,123 @@
+#include <Server/Json.h>
+
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <vector>
+
+TEST(JsonReader, ReadsTypedFields) {
+    JsonObject root = JsonObject::parse(
+        R"({"id_cat": 3, "id_account": "1", "amount": 12.34, "comment": "Pyaterochka", "ok": true, "none": null})");
+    EXPECT_EQ(root.get<int>("id_cat"), 3);
+    EXPECT_EQ(root.get<int>("id_account"), 1); // Numeric strings are numbers too
+    EXPECT_EQ(root.get<Money>("amount").minor(), 1234);
+    EXPECT_EQ(root.get<std::string>("comment"), "Pyaterochka");
+    EXPECT_TRUE(root.get<bool>("ok"));
+    EXPECT_EQ(root.get<std::string>("none", "default"), "default");
+    EXPECT_EQ(root.get<std::string>("missing", "default"), "default");
+    EXPECT_THROW(root.get<int>("missing"), JsonError);
+}
+
+TEST(JsonReader, RefusesAmountsWithAThirdFractionDigit) {
+    JsonObject root = JsonObject::parse(R"({"amount": 1.234, "text": "1.", "negative": "-0.05"})");
+    EXPECT_THROW(root.get<Money>("amount"), JsonError);
+    EXPECT_THROW(root.get<Money>("text"), JsonError);
+    EXPECT_EQ(root.get<Money>("negative").minor(), -5);
+}
+
+TEST(JsonReader, KeepsNestedValuesRaw) {
+    JsonObject root = JsonObject::parse(R"({"list": [1, {"a": [2]}], "object": {"b": "}"}})");
+    EXPECT_EQ(root.find("list")->type(), JsonValue::Type::Array);
+    EXPECT_EQ(root.find("list")->text(), R"([1, {"a": [2]}])");
+    EXPECT_EQ(root.find("object")->text(), R"({"b": "}"})");
+}
+
+TEST(JsonReader, AcceptsTheNumberGrammar) {
+    for (std::string_view number : {"0", "-0", "12", "-12.5", "0.25", "1e5", "1E+5", "-2.5e-3"}) {
+        std::string text = R"({"n": )" + std::string(number) + "}";
+        EXPECT_EQ(JsonObject::parse(text).find("n")->text(), number);
+    }
+}
+
+TEST(JsonReader, RejectsMalformedNumbers) {
+    for (std::string_view number : {"1-2e+", "01", "-", "1.", ".5", "+1", "1e", "1e+", "1.e5", "--1", "0x10"}) {
+        std::string text = R"({"n": )" + std::string(number) + "}";
+        EXPECT_THROW(JsonObject::parse(text), JsonError) << number;
+    }
+}
+
+TEST(JsonReader, RejectsMalformedDocuments) {
+    for (std::string_view text : {"", "{", R"({"a" 1})", R"({"a": 1,})", R"({"a": "x)", R"({"a": 1} 2)", "[1]",
+                                  "{\"a\": \"\x01\"}"}) {
+        EXPECT_THROW(JsonObject::parse(text), JsonError) << text;
+    }
+}
+
+TEST(JsonReader, LimitsNesting) {
+    auto nested = [](int depth) {
+        return R"({"list": )" + std::string(depth, '[') + std::string(depth, ']') + "}";
+    };
+    EXPECT_EQ(JsonObject::parse(nested(ENCODER_MAX_DEPTH)).find("list")->type(), JsonValue::Type::Array);
+    EXPECT_THROW(JsonObject::parse(nested(ENCODER_MAX_DEPTH + 1)), JsonError);
+
+    // Deep enough to overflow the stack if the parser recursed without a limit
+    std::string deep = R"({"list": )" + std::string(4'000'000, '[');
+    EXPECT_THROW(JsonObject::parse(deep), JsonError);
+    EXPECT_THROW(forEachJsonObject("[" + deep.substr(0, 1'000), [](const JsonObject &) {}), JsonError);
+}
+
+TEST(JsonReader, UnescapesStrings) {
+    JsonObject root = JsonObject::parse(R"({"s": "a\"b\\c\/d\n\u00e9\u20ac\ud83d\ude00"})");
+    EXPECT_EQ(root.get<std::string>("s"), "a\"b\\c/d\n\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80");
+}
+
+TEST(JsonReader, RejectsIncorrectEscapes) {
+    // Refused while parsing, although the field is never read
+    for (std::string_view text : {R"({"a": "\q"})", R"({"a": "\u12"})", R"({"a": "\u12g4"})", R"({"a": "\x41"})",
+                                  R"({"a": "\)", R"({"a": "\u)"}) {
+        EXPECT_THROW(JsonObject::parse(text), JsonError) << text;
+    }
+}
+
+TEST(JsonReader, RejectsUnpairedSurrogates) {
+    for (std::string_view text : {R"({"s": "\ud83d"})", R"({"s": "\ud83dx"})", R"({"s": "\ud83dA"})",
+                                  R"({"s": "\ud83d\ud83d"})", R"({"s": "\ude00"})"}) {
+        EXPECT_THROW(JsonObject::parse(text).get<std::string>("s"), JsonError) << text;
+    }
+}
+
+TEST(JsonReader, ReadsArraysOfObjects) {
+    std::vector<int> ids;
+    forEachJsonObject(R"([{"id": 1}, {"id": 2}, {"id": 3}])", [&](const JsonObject &object) {
+        ids.push_back(object.get<int>("id"));
+    });
+    EXPECT_EQ(ids, (std::vector<int>{1, 2, 3}));
+    EXPECT_THROW(forEachJsonObject(R"([{"id": 1}, 2])", [](const JsonObject &) {}), JsonError);
+}
+
+TEST(JsonWriter, WritesDocuments) {
+    JsonWriter writer;
+    writer.beginObject().key("id").value(7).key("amount").value(Money::fromMinor(-5)).key("list").beginArray();
+    writer.value(true).null().value(0.5).endArray().key("text").value("a\"b\n\x01").endObject();
+    EXPECT_EQ(writer.str(), R"({"id":7,"amount":-0.05,"list":[true,null,0.5],"text":"a\"b\n\u0001"})");
+}
+
+TEST(JsonWriter, WritesNonFiniteNumbersAsNull) {
+    JsonWriter writer;
+    writer.beginArray().value(std::numeric_limits<double>::infinity()).value(std::nan("")).endArray();
+    EXPECT_EQ(writer.str(), "[null,null]");
+}
+
+TEST(JsonWriter, RoundTripsThroughTheReader) {
+    JsonWriter writer;
+    writer.beginObject().key("id").value(std::numeric_limits<std::int64_t>::min());
+    writer.key("amount").value(Money::fromMinor(std::numeric_limits<std::int64_t>::max()));
+    writer.key("text").value("quote \" slash \\ tab \t").endObject();
+    JsonObject root = JsonObject::parse(writer.str());
+    EXPECT_EQ(root.get<long long>("id"), std::numeric_limits<std::int64_t>::min());
+    EXPECT_EQ(root.get<Money>("amount").minor(), std::numeric_limits<std::int64_t>::max());
+    EXPECT_EQ(root.get<std::string>("text"), "quote \" slash \\ tab \t");
+}
@@ -0,0 +1,112 @@
+#include <Server/Money.h>
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <string_view>
+
+namespace {
+    // Parses the whole text, fails the test when fromChars stops early or reports an error
+    Money parse(std::string_view text) {
+        Money money;
+        auto [end, error] = fromChars(text.data(), text.data() + text.size(), money);
+        EXPECT_EQ(error, std::errc()) << text;
+        EXPECT_EQ(end, text.data() + text.size()) << text;
+        return money;
+    }
+
+    std::string format(Money money) {
+        std::array<char, MONEY_MAX_CHARS> buffer{};
+        auto [end, error] = toChars(buffer.data(), buffer.data() + buffer.size(), money);
+        EXPECT_EQ(error, std::errc());
+        return {buffer.data(), end};
+    }
+
+    constexpr std::int64_t lowest = std::numeric_limits<std::int64_t>::min();
+    constexpr std::int64_t highest = std::numeric_limits<std::int64_t>::max();
+}
+
+TEST(Money, ParsesUnitsAndFractions) {
+    EXPECT_EQ(parse("0").minor(), 0);
+    EXPECT_EQ(parse("12").minor(), 1200);
+    EXPECT_EQ(parse("12.5").minor(), 1250);
+    EXPECT_EQ(parse("12.34").minor(), 1234);
+    EXPECT_EQ(parse("-12.34").minor(), -1234);
+}
+
+TEST(Money, ParsesNegativeBelowOneUnit) {
+    EXPECT_EQ(parse("-0.05").minor(), -5);
+    EXPECT_EQ(parse("-0.5").minor(), -50);
+    EXPECT_EQ(parse("-0").minor(), 0);
+}
+
+TEST(Money, ParsesTheLimits) {
+    EXPECT_EQ(parse("-92233720368547758.08").minor(), lowest);
+    EXPECT_EQ(parse("92233720368547758.07").minor(), highest);
+}
+
+TEST(Money, RejectsOverflow) {
+    Money money = Money::fromMinor(42);
+    for (std::string_view text : {"92233720368547758.08", "-92233720368547758.09", "100000000000000000",
+                                  "99999999999999999999999"}) {
+        auto [end, error] = fromChars(text.data(), text.data() + text.size(), money);
+        EXPECT_EQ(error, std::errc::result_out_of_range) << text;
+    }
+    EXPECT_EQ(money.minor(), 42); // Left as it was
+}
+
+TEST(Money, StopsAtAThirdFractionDigit) {
+    std::string_view text = "1.234";
+    Money money;
+    auto [end, error] = fromChars(text.data(), text.data() + text.size(), money);
+    EXPECT_EQ(error, std::errc());
+    EXPECT_EQ(end, text.data() + 4);
+    EXPECT_EQ(money.minor(), 123);
+}
+
+TEST(Money, StopsAtAPointWithoutDigits) {
+    std::string_view text = "1.";
+    Money money;
+    auto [end, error] = fromChars(text.data(), text.data() + text.size(), money);
+    EXPECT_EQ(error, std::errc());
+    EXPECT_EQ(end, text.data() + 1);
+    EXPECT_EQ(money.minor(), 100);
+}
+
+TEST(Money, RejectsTextWithoutDigits) {
+    for (std::string_view text : {"", ".", "-", "-.5", ".5", "+1", "abc"}) {
+        Money money;
+        auto [end, error] = fromChars(text.data(), text.data() + text.size(), money);
+        EXPECT_EQ(error, std::errc::invalid_argument) << text;
+        EXPECT_EQ(end, text.data()) << text;
+    }
+}
+
+TEST(Money, FormatsTheShortestForm) {
+    EXPECT_EQ(format(Money::fromMinor(0)), "0");
+    EXPECT_EQ(format(Money::fromMinor(1200)), "12");
+    EXPECT_EQ(format(Money::fromMinor(1250)), "12.5");
+    EXPECT_EQ(format(Money::fromMinor(1234)), "12.34");
+    EXPECT_EQ(format(Money::fromMinor(-5)), "-0.05");
+    EXPECT_EQ(format(Money::fromMinor(-50)), "-0.5");
+    EXPECT_EQ(format(Money::fromMinor(lowest)), "-92233720368547758.08");
+    EXPECT_EQ(format(Money::fromMinor(highest)), "92233720368547758.07");
+    EXPECT_EQ(format(Money::fromMinor(lowest)).size(), MONEY_MAX_CHARS);
+}
+
+TEST(Money, ReportsASmallBuffer) {
+    std::array<char, 4> buffer{};
+    auto [end, error] = toChars(buffer.data(), buffer.data() + buffer.size(), Money::fromMinor(-1234));
+    EXPECT_EQ(error, std::errc::value_too_large);
+    EXPECT_EQ(toChars(buffer.data(), buffer.data(), Money::fromMinor(-5)).ec, std::errc::value_too_large);
+}
+
+TEST(Money, RoundTrips) {
+    for (std::int64_t minor : std::initializer_list<std::int64_t>{0, 1, -1, 10, -99, 100, 123456789, lowest, lowest + 1,
+                                                                  highest}) {
+        EXPECT_EQ(parse(format(Money::fromMinor(minor))).minor(), minor);
+    }
+}